@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -39,7 +36,8 @@
        it is 1, for the second half it is 0.  This is useful for
        generating a tone on a speaker.
 
-     - Other modes are less useful.
+     - Other modes are less useful here.  See pit_start_oneshot()
+       for mode 0.
 
    FREQUENCY is the number of periods per second, in Hz. */
 void
@@ -81,3 +79,45 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts the given CHANNEL counting down, once, from COUNT
+   cycles of the PIT's PIT_HZ clock, with 0 meaning 65536.  This
+   is mode 0 ("interrupt on terminal count"): the channel's
+   output goes high when the count runs out and stays high, so
+   for channel 0 exactly one interrupt is raised.  The counter
+   keeps counting down, wrapping around, until the channel is
+   reconfigured. */
+void
+pit_start_oneshot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the current value of CHANNEL's counter, that is, the
+   number of PIT cycles left until it next reaches zero. */
+uint16_t
+pit_read_counter (int channel)
+{
+  enum intr_level old_level;
+  uint16_t count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Latch the counter so that the two bytes we read belong
+     together. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  return count;
+}
@@ -4,6 +4,7 @@
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -20,11 +21,49 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Pending alarms, ordered by tick so that the next one due is
+   always at the top. */
+static struct heap alarms;
+
+/* Dynamic ticks.
+
+   With timer_tickless set, the idle thread calls
+   timer_idle_enter() just before it halts.  Instead of waking
+   up on every tick only to find nothing to do, it reprograms
+   the PIT to raise a single interrupt at the next tick on which
+   an alarm is due, or as far ahead as the PIT's 16-bit counter
+   reaches if that comes sooner.  When that interrupt arrives
+   the skipped ticks are accounted to the idle thread and the
+   PIT goes back to periodic mode.
+
+   If some other interrupt makes a thread runnable first, the
+   scheduler calls timer_idle_exit() before switching away from
+   the idle thread.  It accounts for the ticks that have fully
+   passed, then arms one last one-shot interrupt for the rest of
+   the current tick so that periodic ticks resume in phase. */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+static enum
+  {
+    TICK_PERIODIC,      /* Periodic ticks, one per interrupt. */
+    TICK_IDLE,          /* One-shot covering oneshot_ticks idle ticks. */
+    TICK_REALIGN        /* One-shot to the next tick boundary. */
+  }
+tick_mode;
+static int64_t oneshot_ticks;   /* Ticks covered, in TICK_IDLE mode. */
+static uint16_t oneshot_count;  /* PIT count programmed, in TICK_IDLE mode. */
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static heap_less_func alarm_less;
+static void fire_alarms (void);
+static void wake_sleeper (struct timer_alarm *);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -36,6 +75,7 @@ void
 timer_init (void) 
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  heap_init (&alarms, alarm_less, NULL);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -86,15 +126,89 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The calling thread blocks until an alarm wakes it up, so
+   sleeping threads take no CPU time. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  timer_alarm_init (&cur->sleep_alarm, wake_sleeper, cur);
+  timer_alarm_set (&cur->sleep_alarm, timer_ticks () + ticks);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Alarm function for timer_sleep(). */
+static void
+wake_sleeper (struct timer_alarm *alarm)
+{
+  thread_unblock (alarm->aux);
+}
+
+/* Initializes ALARM to call FUNC when it goes off.  FUNC may
+   find AUX in ALARM's `aux' member.  The alarm is not set. */
+void
+timer_alarm_init (struct timer_alarm *alarm, timer_alarm_func *func,
+                  void *aux)
+{
+  ASSERT (alarm != NULL);
+  ASSERT (func != NULL);
+
+  alarm->func = func;
+  alarm->aux = aux;
+  alarm->set = false;
+}
+
+/* Sets ALARM, which must not already be set, to go off at timer
+   tick TICK, or at the next tick if TICK has already passed.
+
+   An alarm function runs with interrupts off, usually within
+   the timer interrupt handler, so it must not sleep.  It is
+   typically used to unblock a thread or queue deferred work. */
+void
+timer_alarm_set (struct timer_alarm *alarm, int64_t tick)
+{
+  enum intr_level old_level;
+
+  ASSERT (alarm != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (!alarm->set);
+  alarm->tick = tick;
+  alarm->set = true;
+  heap_push (&alarms, &alarm->elem);
+  intr_set_level (old_level);
+}
+
+/* Cancels ALARM.  Returns true if it was set, or false if it
+   was not set or has already gone off. */
+bool
+timer_alarm_cancel (struct timer_alarm *alarm)
+{
+  enum intr_level old_level;
+  bool was_set;
+
+  ASSERT (alarm != NULL);
+
+  old_level = intr_disable ();
+  was_set = alarm->set;
+  if (was_set)
+    {
+      heap_remove (&alarms, &alarm->elem);
+      alarm->set = false;
+    }
+  intr_set_level (old_level);
+
+  return was_set;
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -167,14 +281,138 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  If timer_tickless is set and no alarm is
+   due within the next tick, switches the PIT to one-shot mode
+   so that the CPU is not woken up again until one is, or until
+   the PIT's counter runs out.
+
+   With more than one CPU online, the PIT keeps ticking, because
+   another CPU may set an alarm at any time. */
+void
+timer_idle_enter (void)
+{
+  uint16_t remaining;
+  int64_t cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || tick_mode != TICK_PERIODIC || cpu_cnt > 1)
+    return;
+
+  /* The first interrupt we skip is the one due in REMAINING
+     cycles; each further one adds a full tick. */
+  remaining = pit_read_counter (0);
+  if (remaining == 0 || remaining > PIT_TICK_COUNT)
+    return;
+  cnt = 1 + (UINT16_MAX - remaining) / PIT_TICK_COUNT;
+  if (!heap_empty (&alarms))
+    {
+      struct timer_alarm *a = heap_entry (heap_top (&alarms),
+                                          struct timer_alarm, elem);
+      if (a->tick - ticks < cnt)
+        cnt = a->tick - ticks;
+    }
+  if (cnt <= 1)
+    return;
+
+  tick_mode = TICK_IDLE;
+  oneshot_ticks = cnt;
+  oneshot_count = remaining + (cnt - 1) * PIT_TICK_COUNT;
+  pit_start_oneshot (0, oneshot_count);
+}
+
+/* Called by the scheduler, with interrupts off, when the idle
+   thread is about to give up the CPU to another thread.  If the
+   PIT is in one-shot mode, accounts for the ticks that passed
+   while idle and arranges to return to periodic ticks at the
+   next tick boundary. */
+void
+timer_idle_exit (void)
+{
+  uint16_t remaining;
+  int64_t passed;
+  unsigned elapsed, first;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tick_mode != TICK_IDLE)
+    return;
+
+  /* If the count already ran out, the interrupt is pending and
+     timer_interrupt() will do the accounting. */
+  remaining = pit_read_counter (0);
+  if (remaining == 0 || remaining > oneshot_count)
+    return;
+
+  /* Figure out how many tick boundaries have passed since
+     timer_idle_enter() and how far away the next one is. */
+  elapsed = oneshot_count - remaining;
+  first = oneshot_count - (oneshot_ticks - 1) * PIT_TICK_COUNT;
+  passed = elapsed < first ? 0 : 1 + (elapsed - first) / PIT_TICK_COUNT;
+  remaining = first + passed * PIT_TICK_COUNT - elapsed;
+
+  ticks += passed;
+  thread_idle_ticks (passed);
+  fire_alarms ();
+
+  tick_mode = TICK_REALIGN;
+  pit_start_oneshot (0, remaining);
+}
+
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  if (tick_mode != TICK_PERIODIC)
+    {
+      /* All but the last of the ticks the one-shot interrupt
+         covered were spent in the idle thread with no interrupt
+         taken.  The last one is an ordinary tick. */
+      if (tick_mode == TICK_IDLE)
+        {
+          ticks += oneshot_ticks - 1;
+          thread_idle_ticks (oneshot_ticks - 1);
+        }
+      tick_mode = TICK_PERIODIC;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+
   ticks++;
+  fire_alarms ();
   thread_tick ();
 }
 
+/* Runs every alarm whose tick has arrived.  Usually there is
+   none, which takes only a look at the top of the heap.  An
+   alarm is unset before its function runs, so the function may
+   set it again. */
+static void
+fire_alarms (void)
+{
+  while (!heap_empty (&alarms))
+    {
+      struct timer_alarm *a = heap_entry (heap_top (&alarms),
+                                          struct timer_alarm, elem);
+      if (a->tick > ticks)
+        break;
+      heap_pop (&alarms);
+      a->set = false;
+      a->func (a);
+    }
+}
+
+/* Returns true if alarm A is due to go off before alarm B. */
+static bool
+alarm_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct timer_alarm *a = heap_entry (a_, struct timer_alarm, elem);
+  const struct timer_alarm *b = heap_entry (b_, struct timer_alarm, elem);
+
+  return a->tick < b->tick;
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
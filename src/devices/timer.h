@@ -1,12 +1,19 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <heap.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* If true, stop the periodic tick while only the idle thread
+   has work.  Controlled by kernel command-line option
+   "-tickless". */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
 
@@ -19,11 +26,30 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+/* Alarms, for running a function at a given timer tick. */
+struct timer_alarm;
+typedef void timer_alarm_func (struct timer_alarm *);
+struct timer_alarm
+  {
+    int64_t tick;               /* Tick to go off at. */
+    bool set;                   /* True if pending. */
+    timer_alarm_func *func;     /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    struct heap_elem elem;      /* Element in pending alarms heap. */
+  };
+
+void timer_alarm_init (struct timer_alarm *, timer_alarm_func *, void *aux);
+void timer_alarm_set (struct timer_alarm *, int64_t tick);
+bool timer_alarm_cancel (struct timer_alarm *);
+
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Dynamic ticks. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
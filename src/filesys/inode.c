@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -57,11 +58,15 @@ byte_to_sector (const struct inode *inode, off_t pos)
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* In-memory inodes. */
+static struct slab_cache inode_cache;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  slab_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL, NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -127,7 +132,7 @@ inode_open (block_sector_t sector)
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = slab_alloc (&inode_cache);
   if (inode == NULL)
     return NULL;
 
@@ -181,7 +186,7 @@ inode_close (struct inode *inode)
                             bytes_to_sectors (inode->data.length)); 
         }
 
-      free (inode); 
+      slab_free (&inode_cache, inode); 
     }
 }
 
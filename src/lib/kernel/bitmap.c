@@ -21,13 +21,31 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Number of elements summarized by one bit of a summary. */
+#define GROUP_ELEMS ELEM_BITS
+
+/* Number of bits summarized by one bit of a summary. */
+#define GROUP_BITS (GROUP_ELEMS * ELEM_BITS)
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A bitmap with more than GROUP_BITS bits also has a summary
+   level, with one bit per group of GROUP_ELEMS elements in each
+   of two arrays: a bit in `full' is set if every bit in the
+   group is true, and a bit in `empty' is set if every bit in the
+   group is false.  That lets bitmap_scan() pass over a whole
+   group with no bits of the value it is looking for at once.
+   Updating a summary is not atomic with updating the bit that
+   caused it, so a bitmap that is modified concurrently needs
+   outside locking. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* Groups with all bits true, or null. */
+    elem_type *empty;   /* Groups with all bits false, or null. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +86,137 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns a bit mask in which the bits actually used in element
+   IDX of B's bits are set to 1 and the rest are set to 0. */
+static inline elem_type
+elem_mask (const struct bitmap *b, size_t idx)
+{
+  return idx == elem_cnt (b->bit_cnt) - 1 ? last_mask (b) : (elem_type) -1;
+}
+
+/* Returns an elem_type with bits START through START + CNT,
+   exclusive, turned on.  START + CNT must not exceed
+   ELEM_BITS. */
+static inline elem_type
+range_mask (size_t start, size_t cnt)
+{
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1;
+  return mask << start;
+}
+
+/* Returns the number of bits set in X.  (The kernel is not
+   linked with libgcc, which __builtin_popcount() would need.) */
+static inline size_t
+popcount (elem_type x)
+{
+  size_t cnt = 0;
+
+  for (; x != 0; x &= x - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Returns the number of elements required for a summary of a
+   bitmap with BIT_CNT bits, which is 0 for bitmaps that are too
+   small to need one. */
+static inline size_t
+summary_elem_cnt (size_t bit_cnt)
+{
+  size_t group_cnt = DIV_ROUND_UP (bit_cnt, GROUP_BITS);
+  return group_cnt > 1 ? elem_cnt (group_cnt) : 0;
+}
+
+/* Returns the number of bytes required for the bits and summary
+   of a bitmap with BIT_CNT bits. */
+static inline size_t
+storage_size (size_t bit_cnt)
+{
+  return byte_cnt (bit_cnt) + 2 * sizeof (elem_type) * summary_elem_cnt (bit_cnt);
+}
+
+/* Points B's summary arrays into the storage after its bits, or
+   sets them to null if B is too small to need a summary. */
+static void
+init_summary (struct bitmap *b)
+{
+  size_t summary_cnt = summary_elem_cnt (b->bit_cnt);
+
+  if (summary_cnt > 0)
+    {
+      b->full = b->bits + elem_cnt (b->bit_cnt);
+      b->empty = b->full + summary_cnt;
+    }
+  else
+    b->full = b->empty = NULL;
+}
+
+/* Recomputes B's summary bits for groups FIRST through LAST,
+   inclusive. */
+static void
+update_groups (struct bitmap *b, size_t first, size_t last)
+{
+  size_t group;
+
+  if (b->full == NULL)
+    return;
+  for (group = first; group <= last; group++)
+    {
+      size_t start = group * GROUP_ELEMS;
+      size_t end = start + GROUP_ELEMS;
+      bool full = true, empty = true;
+      size_t i;
+
+      if (end > elem_cnt (b->bit_cnt))
+        end = elem_cnt (b->bit_cnt);
+      for (i = start; i < end && (full || empty); i++)
+        {
+          full = full && b->bits[i] == elem_mask (b, i);
+          empty = empty && b->bits[i] == 0;
+        }
+
+      if (full)
+        b->full[elem_idx (group)] |= bit_mask (group);
+      else
+        b->full[elem_idx (group)] &= ~bit_mask (group);
+      if (empty)
+        b->empty[elem_idx (group)] |= bit_mask (group);
+      else
+        b->empty[elem_idx (group)] &= ~bit_mask (group);
+    }
+}
+
+/* Updates B's summary after a change to element IDX of its
+   bits.  The group's summary bits need to be recomputed only if
+   the element just became entirely true or false. */
+static void
+elem_changed (struct bitmap *b, size_t idx)
+{
+  size_t group = idx / GROUP_ELEMS;
+  elem_type bits = b->bits[idx];
+
+  if (b->full == NULL)
+    return;
+  if (bits == elem_mask (b, idx) || bits == 0)
+    update_groups (b, group, group);
+  else
+    {
+      b->full[elem_idx (group)] &= ~bit_mask (group);
+      b->empty[elem_idx (group)] &= ~bit_mask (group);
+    }
+}
+
+/* Returns true if the summary of B says that the group that
+   begins at bit BIT_IDX has no bits set to VALUE. */
+static inline bool
+group_lacks (const struct bitmap *b, size_t bit_idx, bool value)
+{
+  size_t group = bit_idx / GROUP_BITS;
+  const elem_type *summary = value ? b->empty : b->full;
+
+  return (summary != NULL && bit_idx % GROUP_BITS == 0
+          && (summary[elem_idx (group)] & bit_mask (group)) != 0);
+}
 
 /* Creation and destruction. */
 
@@ -82,9 +231,10 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
+      b->bits = malloc (storage_size (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
+          init_summary (b);
           bitmap_set_all (b, false);
           return b;
         }
@@ -105,6 +255,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  init_summary (b);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +265,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + storage_size (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -163,6 +314,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  elem_changed (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -176,6 +328,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  elem_changed (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,6 +344,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  elem_changed (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -213,18 +367,34 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is set atomically, as by bitmap_mark() or
+   bitmap_reset(). */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t end = start + cnt;
   size_t i;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+  for (i = start; i < end; )
+    {
+      size_t ofs = i % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < end - i ? ELEM_BITS - ofs : end - i;
+      elem_type mask = range_mask (ofs, n);
+
+      if (value)
+        asm ("orl %1, %0" : "+m" (b->bits[elem_idx (i)]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "+m" (b->bits[elem_idx (i)]) : "r" (~mask) : "cc");
+      i += n;
+    }
+  update_groups (b, start / GROUP_BITS, (end - 1) / GROUP_BITS);
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,17 +402,23 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t i, true_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  true_cnt = 0;
+  for (i = start; i < end; )
+    {
+      size_t ofs = i % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < end - i ? ELEM_BITS - ofs : end - i;
+
+      true_cnt += popcount (b->bits[elem_idx (i)] & range_mask (ofs, n));
+      i += n;
+    }
+  return value ? true_cnt : cnt - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,15 +426,28 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t end = start + cnt;
   size_t i;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  for (i = start; i < end; )
+    {
+      size_t ofs = i % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < end - i ? ELEM_BITS - ofs : end - i;
+      elem_type bits = b->bits[elem_idx (i)];
+
+      if (group_lacks (b, i, value) && end - i >= GROUP_BITS)
+        {
+          i += GROUP_BITS;
+          continue;
+        }
+      if ((value ? bits : ~bits) & range_mask (ofs, n))
+        return true;
+      i += n;
+    }
   return false;
 }
 
@@ -291,20 +480,67 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Works an element at a time: counts the bits set to VALUE at
+   the bottom of each element with a single bit scan instruction,
+   and skips runs of other bits the same way, so that each
+   element is examined at most once.  Whole groups of elements
+   that the summary says have no bits set to VALUE are skipped
+   at once. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t run_start = start;     /* Start of current run of VALUE. */
+  size_t i = start;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  while (i < b->bit_cnt)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t ofs = i % ELEM_BITS;
+      size_t avail = ELEM_BITS - ofs;
+      size_t match_cnt, skip_cnt;
+      elem_type bits;
+
+      if (group_lacks (b, i, value))
+        {
+          i += GROUP_BITS;
+          run_start = i;
+          continue;
+        }
+
+      /* Get the bits from I to the end of the element, or of the
+         bitmap, with bits set to VALUE as 1s, starting at bit
+         0. */
+      if (avail > b->bit_cnt - i)
+        avail = b->bit_cnt - i;
+      bits = b->bits[elem_idx (i)];
+      if (!value)
+        bits = ~bits;
+      bits = (bits >> ofs) & range_mask (0, avail);
+
+      /* Extend the current run by the matches at the bottom. */
+      match_cnt = ~bits != 0 ? (size_t) __builtin_ctzl (~bits) : ELEM_BITS;
+      if (i + match_cnt - run_start >= cnt)
+        return run_start;
+      if (match_cnt == avail)
+        {
+          i += avail;
+          continue;
+        }
+
+      /* Skip the bits that don't match, and start a new run. */
+      bits >>= match_cnt;
+      skip_cnt = bits != 0 ? (size_t) __builtin_ctzl (bits) : avail - match_cnt;
+      i += match_cnt + skip_cnt;
+      run_start = i;
     }
   return BITMAP_ERROR;
 }
@@ -346,6 +582,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      update_groups (b, 0, (b->bit_cnt - 1) / GROUP_BITS);
     }
   return success;
 }
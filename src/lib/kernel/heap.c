@@ -0,0 +1,185 @@
+/* Priority queue.
+
+   See heap.h for basic information. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *link (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_siblings (struct heap *, struct heap_elem *);
+
+/* Initializes heap H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into heap H. */
+void
+heap_push (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = h->root != NULL ? link (h, h->root, e) : e;
+  h->elem_cnt++;
+}
+
+/* Returns the least element in H, or a null pointer if H is
+   empty.  The element is not removed. */
+struct heap_elem *
+heap_top (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->root;
+}
+
+/* Removes and returns the least element in H, which must not be
+   empty. */
+struct heap_elem *
+heap_pop (struct heap *h)
+{
+  struct heap_elem *top;
+
+  ASSERT (h != NULL);
+  ASSERT (h->root != NULL);
+
+  top = h->root;
+  h->root = merge_siblings (h, top->child);
+  h->elem_cnt--;
+
+  top->child = top->next = top->prev = NULL;
+  return top;
+}
+
+/* Removes E, which must be an element of H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  struct heap_elem *subtree;
+
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    {
+      heap_pop (h);
+      return;
+    }
+
+  /* Unlink E and its subtree from its parent's child list. */
+  ASSERT (e->prev != NULL);
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+
+  /* Merge E's children back into the heap. */
+  subtree = merge_siblings (h, e->child);
+  if (subtree != NULL)
+    h->root = link (h, h->root, subtree);
+  h->elem_cnt--;
+
+  e->child = e->next = e->prev = NULL;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  return h->root == NULL;
+}
+
+/* Combines the heap-ordered trees rooted at A and B into a
+   single tree and returns its root.  The root with the larger
+   value becomes the leftmost child of the other.  The `next'
+   and `prev' members of A and B are ignored and overwritten. */
+static struct heap_elem *
+link (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Combines the list of sibling trees starting at FIRST into a
+   single tree and returns its root, or a null pointer if FIRST
+   is null.
+
+   This is the standard two-pass pairing: first link siblings
+   in pairs from left to right, then link the resulting trees
+   from right to left.  It is done iteratively, threading the
+   intermediate trees through their `next' members, because a
+   recursive version could exhaust a kernel stack. */
+static struct heap_elem *
+merge_siblings (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root;
+
+  /* First pass: link pairs, pushing each result onto PAIRS so
+     that the second pass visits them from right to left. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      if (b != NULL)
+        {
+          first = b->next;
+          a = link (h, a, b);
+        }
+      else
+        first = NULL;
+
+      a->next = pairs;
+      pairs = a;
+    }
+  if (pairs == NULL)
+    return NULL;
+
+  /* Second pass: accumulate from right to left. */
+  root = pairs;
+  pairs = pairs->next;
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      root = link (h, root, pairs);
+      pairs = next;
+    }
+
+  root->next = root->prev = NULL;
+  return root;
+}
@@ -0,0 +1,70 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap: a heap-ordered multiway tree in which
+   each node points to its leftmost child and to its siblings.
+   Insertion is O(1), and removing the top element or any other
+   element is O(lg n) amortized.  Finding the top element is
+   O(1).
+
+   Like the linked list and hash table implementations, the heap
+   does not use dynamic allocation.  Each structure that can be
+   in a heap must embed a struct heap_elem member, and the
+   heap_entry macro converts a struct heap_elem back into a
+   pointer to the structure that contains it.  Refer to
+   lib/kernel/list.h for a detailed explanation of the
+   technique.
+
+   The "top" of the heap is its least element according to the
+   heap's less function.  Elements that compare equal come out
+   in no particular order. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Next sibling to the right. */
+    struct heap_elem *prev;     /* Previous sibling, or parent if leftmost. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) (HEAP_ELEM)            \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Least element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in heap. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_top (const struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
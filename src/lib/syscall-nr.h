@@ -28,7 +28,14 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FUTEX_WAIT,             /* Wait on a user-space futex. */
+    SYS_FUTEX_WAKE,             /* Wake threads waiting on a futex. */
+    SYS_THREAD_CREATE,          /* Start a thread in this process. */
+    SYS_THREAD_JOIN,            /* Wait for a thread to die. */
+    SYS_FORK                    /* Start a copy of this process. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -182,3 +182,49 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+futex_wait (int *addr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+/* Where threads started by thread_create() begin. */
+static void NO_RETURN
+thread_start (thread_func *func, void *aux)
+{
+  thread_exit (func (aux));
+}
+
+tid_t
+thread_create (thread_func *func, void *aux)
+{
+  return syscall3 (SYS_THREAD_CREATE, thread_start, func, aux);
+}
+
+int
+thread_join (tid_t tid)
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+/* Ends the calling thread.  Calling exit() in the process's
+   first thread ends the process, once all its other threads have
+   also ended. */
+void
+thread_exit (int status)
+{
+  exit (status);
+}
+
+pid_t
+fork (void)
+{
+  return syscall0 (SYS_FORK);
+}
@@ -8,6 +8,14 @@
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
+/* Function run by a thread started by thread_create().  Its
+   return value is the thread's exit status. */
+typedef int thread_func (void *aux);
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
@@ -45,4 +53,12 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+tid_t thread_create (thread_func *, void *aux);
+int thread_join (tid_t);
+pid_t fork (void);
+void thread_exit (int status) NO_RETURN;
+
 #endif /* lib/user/syscall.h */
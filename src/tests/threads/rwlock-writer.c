@@ -0,0 +1,56 @@
+/* Checks that a writer waiting for a readers-writer lock keeps
+   new readers out, so that it gets the lock as soon as the
+   readers already holding it let go. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func writer_thread, reader_thread;
+static struct rwlock rwlock;
+static struct semaphore done;
+
+void
+test_rwlock_writer (void)
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rwlock);
+  sema_init (&done, 0);
+
+  rwlock_acquire_read (&rwlock);
+  msg ("Main thread acquired read lock.");
+
+  /* Each of these runs right away, at its higher priority, until
+     it blocks on the lock. */
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread, NULL);
+  thread_create ("reader", PRI_DEFAULT + 1, reader_thread, NULL);
+
+  msg ("Main thread releasing read lock.");
+  rwlock_release_read (&rwlock);
+  sema_down (&done);
+  sema_down (&done);
+}
+
+static void
+writer_thread (void *aux UNUSED)
+{
+  msg ("Writer waiting.");
+  rwlock_acquire_write (&rwlock);
+  msg ("Writer acquired write lock.");
+  rwlock_release_write (&rwlock);
+  sema_up (&done);
+}
+
+static void
+reader_thread (void *aux UNUSED)
+{
+  msg ("Reader waiting.");
+  rwlock_acquire_read (&rwlock);
+  msg ("Reader acquired read lock.");
+  rwlock_release_read (&rwlock);
+  sema_up (&done);
+}
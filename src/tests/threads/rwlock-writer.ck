@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-writer) begin
+(rwlock-writer) Main thread acquired read lock.
+(rwlock-writer) Writer waiting.
+(rwlock-writer) Reader waiting.
+(rwlock-writer) Main thread releasing read lock.
+(rwlock-writer) Writer acquired write lock.
+(rwlock-writer) Reader acquired read lock.
+(rwlock-writer) end
+EOF
+pass;
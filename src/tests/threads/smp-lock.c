@@ -0,0 +1,66 @@
+/* Checks that a lock provides mutual exclusion between threads
+   running on different CPUs at once.  Several threads each
+   increment a shared counter many times while holding a lock,
+   and the final count must come out exact. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 100000
+
+static thread_func incrementer;
+static struct semaphore done;
+static struct lock lock;
+static volatile int counter;
+static unsigned cpu_mask;       /* Bit N set if a thread ran on cpus[N]. */
+
+void
+test_smp_lock (void)
+{
+  int i;
+
+  msg ("%zu CPUs online.", cpu_cnt);
+  if (cpu_cnt < 2)
+    fail ("need at least 2 CPUs.");
+
+  sema_init (&done, 0);
+  lock_init (&lock);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "incrementer %d", i);
+      thread_create (name, PRI_DEFAULT, incrementer, NULL);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  if (counter != THREAD_CNT * ITER_CNT)
+    fail ("counter is %d, expected %d.", counter, THREAD_CNT * ITER_CNT);
+  msg ("Counter is %d.", counter);
+  if ((cpu_mask & (cpu_mask - 1)) == 0)
+    fail ("all threads ran on one CPU.");
+  msg ("Threads ran on more than one CPU.");
+}
+
+/* Increments the counter ITER_CNT times, under the lock, noting
+   each CPU it runs on. */
+static void
+incrementer (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      lock_acquire (&lock);
+      counter = counter + 1;
+      cpu_mask |= 1u << cpu_current ()->id;
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
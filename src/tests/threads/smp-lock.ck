@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(smp-lock) begin
+(smp-lock) 2 CPUs online.
+(smp-lock) Counter is 400000.
+(smp-lock) Threads ran on more than one CPU.
+(smp-lock) end
+EOF
+pass;
@@ -0,0 +1,61 @@
+/* Checks that the application processors come online and that
+   ready threads move to an idle CPU.  The main thread, on the
+   bootstrap processor, creates several threads that spin for a
+   while, recording which CPUs they run on.  All of them start
+   out queued on the bootstrap processor, so they can only run
+   elsewhere if another CPU steals them. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 4
+#define SPIN_TICKS 20
+
+static thread_func spinner;
+static struct semaphore done;
+static unsigned cpu_mask;       /* Bit N set if a thread ran on cpus[N]. */
+
+void
+test_smp_steal (void)
+{
+  int i;
+
+  msg ("%zu CPUs online.", cpu_cnt);
+  if (cpu_cnt < 2)
+    fail ("need at least 2 CPUs.");
+
+  sema_init (&done, 0);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "spinner %d", i);
+      thread_create (name, PRI_DEFAULT, spinner, NULL);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  if ((cpu_mask & (cpu_mask - 1)) == 0)
+    fail ("all threads ran on one CPU.");
+  msg ("Threads ran on more than one CPU.");
+}
+
+/* Spins for SPIN_TICKS timer ticks, noting each CPU it runs on. */
+static void
+spinner (void *aux UNUSED)
+{
+  int64_t start = timer_ticks ();
+
+  while (timer_elapsed (start) < SPIN_TICKS)
+    {
+      enum intr_level old_level = intr_disable ();
+      cpu_mask |= 1u << cpu_current ()->id;
+      intr_set_level (old_level);
+    }
+  sema_up (&done);
+}
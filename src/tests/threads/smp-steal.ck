@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(smp-steal) begin
+(smp-steal) 2 CPUs online.
+(smp-steal) Threads ran on more than one CPU.
+(smp-steal) end
+EOF
+pass;
@@ -29,6 +29,12 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"workqueue-priority", test_workqueue_priority},
+    {"workqueue-delayed", test_workqueue_delayed},
+    {"rwlock-writer", test_rwlock_writer},
+    {"wait-timeout", test_wait_timeout},
+    {"smp-steal", test_smp_steal},
+    {"smp-lock", test_smp_lock},
 //    {"mlfqs-load-1", test_mlfqs_load_1},
 //    {"mlfqs-load-60", test_mlfqs_load_60},
 //    {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -23,6 +23,12 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_workqueue_priority;
+extern test_func test_workqueue_delayed;
+extern test_func test_rwlock_writer;
+extern test_func test_wait_timeout;
+extern test_func test_smp_steal;
+extern test_func test_smp_lock;
 //extern test_func test_mlfqs_load_1;
 //extern test_func test_mlfqs_load_60;
 //extern test_func test_mlfqs_load_avg;
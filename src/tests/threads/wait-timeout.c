@@ -0,0 +1,80 @@
+/* Checks that sema_down_timeout() and cond_wait_timeout() give
+   up once their timeout expires, and return as soon as they are
+   signaled before it does. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define TIMEOUT 10
+
+/* A long timeout that a signaled wait should never reach. */
+#define LONG_TIMEOUT (1000 * TIMER_FREQ)
+
+static thread_func sema_signaler, cond_signaler;
+static struct semaphore sema;
+static struct lock lock;
+static struct condition cond;
+
+void
+test_wait_timeout (void)
+{
+  int64_t start;
+
+  sema_init (&sema, 0);
+  lock_init (&lock);
+  cond_init (&cond);
+
+  start = timer_ticks ();
+  if (sema_down_timeout (&sema, TIMEOUT))
+    fail ("sema_down_timeout() succeeded on an unsignaled semaphore.");
+  if (timer_elapsed (start) < TIMEOUT)
+    fail ("sema_down_timeout() returned before its timeout.");
+  msg ("Semaphore wait timed out.");
+
+  start = timer_ticks ();
+  thread_create ("sema signaler", PRI_DEFAULT, sema_signaler, NULL);
+  if (!sema_down_timeout (&sema, LONG_TIMEOUT))
+    fail ("sema_down_timeout() timed out though signaled.");
+  if (timer_elapsed (start) >= LONG_TIMEOUT)
+    fail ("sema_down_timeout() waited for its timeout though signaled.");
+  msg ("Semaphore wait was signaled.");
+
+  lock_acquire (&lock);
+  start = timer_ticks ();
+  if (cond_wait_timeout (&cond, &lock, TIMEOUT))
+    fail ("cond_wait_timeout() succeeded on an unsignaled condition.");
+  if (timer_elapsed (start) < TIMEOUT)
+    fail ("cond_wait_timeout() returned before its timeout.");
+  if (!lock_held_by_current_thread (&lock))
+    fail ("cond_wait_timeout() did not reacquire the lock.");
+  msg ("Condition wait timed out.");
+
+  start = timer_ticks ();
+  thread_create ("cond signaler", PRI_DEFAULT, cond_signaler, NULL);
+  if (!cond_wait_timeout (&cond, &lock, LONG_TIMEOUT))
+    fail ("cond_wait_timeout() timed out though signaled.");
+  if (timer_elapsed (start) >= LONG_TIMEOUT)
+    fail ("cond_wait_timeout() waited for its timeout though signaled.");
+  lock_release (&lock);
+  msg ("Condition wait was signaled.");
+}
+
+static void
+sema_signaler (void *aux UNUSED)
+{
+  timer_sleep (TIMEOUT);
+  sema_up (&sema);
+}
+
+static void
+cond_signaler (void *aux UNUSED)
+{
+  timer_sleep (TIMEOUT);
+  lock_acquire (&lock);
+  cond_signal (&cond, &lock);
+  lock_release (&lock);
+}
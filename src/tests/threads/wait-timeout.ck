@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(wait-timeout) begin
+(wait-timeout) Semaphore wait timed out.
+(wait-timeout) Semaphore wait was signaled.
+(wait-timeout) Condition wait timed out.
+(wait-timeout) Condition wait was signaled.
+(wait-timeout) end
+EOF
+pass;
@@ -0,0 +1,69 @@
+/* Checks that delayed work does not run before its delay has
+   passed, that it does run once its alarm goes off, and that
+   canceled delayed work does not run at all. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define DELAY 10
+
+static work_func delayed_work, canceled_work;
+static struct semaphore done;
+static int64_t ran_at;
+static bool canceled_ran;
+
+void
+test_workqueue_delayed (void)
+{
+  struct work w, canceled;
+  int64_t start;
+
+  sema_init (&done, 0);
+  work_init (&w, delayed_work, NULL, WORK_NORMAL);
+  work_init (&canceled, canceled_work, NULL, WORK_NORMAL);
+
+  /* Start at the beginning of a tick, so that the delay is
+     measured in whole ticks. */
+  start = timer_ticks ();
+  while (timer_elapsed (start) == 0)
+    continue;
+  start = timer_ticks ();
+
+  if (!work_queue_delayed (&w, DELAY))
+    fail ("work_queue_delayed() failed.");
+  if (work_queue_delayed (&w, DELAY))
+    fail ("work_queue_delayed() queued pending work twice.");
+  if (!work_queue_delayed (&canceled, DELAY / 2))
+    fail ("work_queue_delayed() failed.");
+  if (!work_cancel (&canceled))
+    fail ("work_cancel() did not find pending work.");
+
+  sema_down (&done);
+  if (ran_at - start < DELAY)
+    fail ("Delayed work ran after %lld ticks, expected at least %d.",
+          ran_at - start, DELAY);
+  msg ("Delayed work ran after its delay.");
+
+  timer_sleep (DELAY);
+  if (canceled_ran)
+    fail ("Canceled work ran.");
+  msg ("Canceled work did not run.");
+}
+
+static void
+delayed_work (struct work *w UNUSED)
+{
+  ran_at = timer_ticks ();
+  sema_up (&done);
+}
+
+static void
+canceled_work (struct work *w UNUSED)
+{
+  canceled_ran = true;
+}
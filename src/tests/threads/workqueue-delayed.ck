@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue-delayed) begin
+(workqueue-delayed) Delayed work ran after its delay.
+(workqueue-delayed) Canceled work did not run.
+(workqueue-delayed) end
+EOF
+pass;
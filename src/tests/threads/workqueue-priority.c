@@ -0,0 +1,68 @@
+/* Queues work in each priority class, lowest first, while the
+   workers are busy, and checks that a worker then runs it most
+   urgent class first. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Number of worker threads started by workqueue_init(). */
+#define WORKER_CNT 2
+
+static work_func block_worker, report_work;
+static struct semaphore started, gate, done;
+
+void
+test_workqueue_priority (void)
+{
+  struct work blockers[WORKER_CNT];
+  struct work low, normal, high;
+  int i;
+
+  sema_init (&started, 0);
+  sema_init (&gate, 0);
+  sema_init (&done, 0);
+
+  /* Keep every worker busy, so that the rest of the work piles
+     up in the queues. */
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      work_init (&blockers[i], block_worker, NULL, WORK_HIGH);
+      work_queue (&blockers[i]);
+    }
+  for (i = 0; i < WORKER_CNT; i++)
+    sema_down (&started);
+
+  work_init (&low, report_work, "low", WORK_LOW);
+  work_init (&normal, report_work, "normal", WORK_NORMAL);
+  work_init (&high, report_work, "high", WORK_HIGH);
+  work_queue (&low);
+  work_queue (&normal);
+  work_queue (&high);
+  msg ("Queued low, normal, and high priority work.");
+
+  /* Free one worker, which should take the work in priority
+     order, then the other. */
+  sema_up (&gate);
+  for (i = 0; i < 3; i++)
+    sema_down (&done);
+  for (i = 1; i < WORKER_CNT; i++)
+    sema_up (&gate);
+}
+
+static void
+block_worker (struct work *w UNUSED)
+{
+  sema_up (&started);
+  sema_down (&gate);
+}
+
+static void
+report_work (struct work *w)
+{
+  msg ("Running %s priority work.", (const char *) w->aux);
+  sema_up (&done);
+}
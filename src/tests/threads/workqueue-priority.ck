@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue-priority) begin
+(workqueue-priority) Queued low, normal, and high priority work.
+(workqueue-priority) Running high priority work.
+(workqueue-priority) Running normal priority work.
+(workqueue-priority) Running low priority work.
+(workqueue-priority) end
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Two threads take turns, each sleeping on a futex until the
+   other hands it the turn.  A lost wakeup hangs the test. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUNDS 100
+
+static volatile int turn;
+static int rounds[2];
+
+/* Waits for turn ME, ROUNDS times, handing the turn to the
+   other thread each time. */
+static void
+play (int me) 
+{
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      while (turn != me)
+        futex_wait ((int *) &turn, !me);
+      rounds[me]++;
+      turn = !me;
+      futex_wake ((int *) &turn, 1);
+    }
+}
+
+static int
+partner (void *aux UNUSED) 
+{
+  play (1);
+  return 0;
+}
+
+void
+test_main (void) 
+{
+  tid_t tid = thread_create (partner, NULL);
+  if (tid == TID_ERROR)
+    fail ("thread_create failed");
+  play (0);
+  if (thread_join (tid) != 0)
+    fail ("thread_join failed");
+  if (rounds[0] != ROUNDS || rounds[1] != ROUNDS)
+    fail ("rounds: %d and %d, expected %d each",
+          rounds[0], rounds[1], ROUNDS);
+  msg ("handed off %d times each way", ROUNDS);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-handoff) begin
+(futex-handoff) handed off 100 times each way
+(futex-handoff) end
+futex-handoff: exit(0)
+EOF
+pass;
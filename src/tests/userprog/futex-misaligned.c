@@ -0,0 +1,16 @@
+/* Passes futex_wait() and futex_wake() an address that is not
+   aligned on an int boundary, which they must reject with -1. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int futexes[2] = {0, 0};
+  int *bad = (int *) ((char *) futexes + 1);
+
+  CHECK (futex_wait (bad, *bad) == -1, "futex_wait on misaligned address");
+  CHECK (futex_wake (bad, 1) == -1, "futex_wake on misaligned address");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-misaligned) begin
+(futex-misaligned) futex_wait on misaligned address
+(futex-misaligned) futex_wake on misaligned address
+(futex-misaligned) end
+futex-misaligned: exit(0)
+EOF
+pass;
@@ -0,0 +1,15 @@
+/* Calls futex_wait() with a value that does not match the
+   futex's, which must return -1 at once instead of sleeping. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int futex = 1;
+
+  CHECK (futex_wait (&futex, 0) == -1, "futex_wait with stale value");
+  CHECK (futex_wake (&futex, 1) == 0, "futex_wake with no waiters");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-mismatch) begin
+(futex-mismatch) futex_wait with stale value
+(futex-mismatch) futex_wake with no waiters
+(futex-mismatch) end
+futex-mismatch: exit(0)
+EOF
+pass;
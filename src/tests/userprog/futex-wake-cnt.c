@@ -0,0 +1,79 @@
+/* Puts three threads to sleep on a futex, then checks that
+   futex_wake() wakes no more threads than it is asked to. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WAITER_CNT 3
+
+static int futex;
+static volatile int ready[WAITER_CNT];
+static volatile int woken[WAITER_CNT];
+
+static int
+waiter (void *i_) 
+{
+  int i = (int) i_;
+
+  ready[i] = 1;
+  while (futex_wait (&futex, 0) != 0)
+    continue;
+  woken[i] = 1;
+  return i;
+}
+
+/* Returns the number of waiters that have returned from
+   futex_wait(). */
+static int
+woken_cnt (void) 
+{
+  int cnt = 0;
+  int i;
+
+  for (i = 0; i < WAITER_CNT; i++)
+    cnt += woken[i];
+  return cnt;
+}
+
+/* Wakes exactly CNT waiters, perhaps over several calls to
+   futex_wake() if some of them are not yet asleep. */
+static void
+wake (int cnt) 
+{
+  while (cnt > 0)
+    {
+      int n = futex_wake (&futex, cnt);
+      if (n < 0 || n > cnt)
+        fail ("futex_wake asked for %d woke %d", cnt, n);
+      cnt -= n;
+    }
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[WAITER_CNT];
+  int i;
+
+  for (i = 0; i < WAITER_CNT; i++)
+    {
+      tids[i] = thread_create (waiter, (void *) i);
+      if (tids[i] == TID_ERROR)
+        fail ("thread_create failed");
+    }
+  for (i = 0; i < WAITER_CNT; i++)
+    while (!ready[i])
+      continue;
+
+  wake (2);
+  while (woken_cnt () < 2)
+    continue;
+  msg ("woke 2 of %d waiters", WAITER_CNT);
+
+  wake (1);
+  for (i = 0; i < WAITER_CNT; i++)
+    if (thread_join (tids[i]) != i)
+      fail ("thread_join returned wrong status");
+  msg ("woke last waiter");
+}
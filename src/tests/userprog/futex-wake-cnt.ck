@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-wake-cnt) begin
+(futex-wake-cnt) woke 2 of 3 waiters
+(futex-wake-cnt) woke last waiter
+(futex-wake-cnt) end
+futex-wake-cnt: exit(0)
+EOF
+pass;
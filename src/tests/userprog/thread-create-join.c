@@ -0,0 +1,33 @@
+/* Starts a few threads that each compute a value, then joins
+   them and checks their exit statuses. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+
+static int
+square (void *n_) 
+{
+  int n = (int) n_;
+  return n * n;
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK ((tids[i] = thread_create (square, (void *) i)) != TID_ERROR,
+           "thread_create %d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      int status = thread_join (tids[i]);
+      if (status != i * i)
+        fail ("thread %d exited with %d, expected %d", i, status, i * i);
+    }
+  msg ("joined %d threads", THREAD_CNT);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-create-join) begin
+(thread-create-join) thread_create 0
+(thread-create-join) thread_create 1
+(thread-create-join) thread_create 2
+(thread-create-join) thread_create 3
+(thread-create-join) joined 4 threads
+(thread-create-join) end
+thread-create-join: exit(0)
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Exits the first thread while one thread loops in user code and
+   another sleeps on a futex that is never woken.  The process
+   must still exit. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static volatile int spinning;
+static volatile int forever = 1;
+static int never;
+
+static int
+spinner (void *aux UNUSED) 
+{
+  spinning = 1;
+  while (forever)
+    continue;
+  return 0;
+}
+
+static int
+sleeper (void *aux UNUSED) 
+{
+  while (forever)
+    futex_wait (&never, 0);
+  return 0;
+}
+
+void
+test_main (void) 
+{
+  CHECK (thread_create (spinner, NULL) != TID_ERROR, "create spinner");
+  CHECK (thread_create (sleeper, NULL) != TID_ERROR, "create sleeper");
+  while (!spinning)
+    continue;
+  msg ("exiting");
+  exit (12);
+}
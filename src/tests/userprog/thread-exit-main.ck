@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-exit-main) begin
+(thread-exit-main) create spinner
+(thread-exit-main) create sleeper
+(thread-exit-main) exiting
+thread-exit-main: exit(12)
+EOF
+pass;
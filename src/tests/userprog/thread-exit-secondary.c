@@ -0,0 +1,22 @@
+/* Calls exit() in a thread other than the first, which ends only
+   that thread.  Its status is returned by thread_join(). */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int
+exiter (void *aux UNUSED) 
+{
+  exit (42);
+}
+
+void
+test_main (void) 
+{
+  tid_t tid;
+
+  CHECK ((tid = thread_create (exiter, NULL)) != TID_ERROR, "thread_create");
+  CHECK (thread_join (tid) == 42, "thread_join");
+  msg ("process still running");
+}
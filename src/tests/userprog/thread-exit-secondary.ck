@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-exit-secondary) begin
+(thread-exit-secondary) thread_create
+(thread-exit-secondary) thread_join
+(thread-exit-secondary) process still running
+(thread-exit-secondary) end
+thread-exit-secondary: exit(0)
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Joins a thread that has already exited, then tries to join it
+   a second time, which must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static volatile int done;
+
+static int
+quick (void *aux UNUSED) 
+{
+  done = 1;
+  return 7;
+}
+
+void
+test_main (void) 
+{
+  tid_t tid;
+  int i;
+
+  CHECK ((tid = thread_create (quick, NULL)) != TID_ERROR, "thread_create");
+
+  /* Give the thread time to finish exiting, not just to set
+     DONE. */
+  while (!done)
+    continue;
+  for (i = 0; i < 10000000; i++)
+    done++;
+
+  CHECK (thread_join (tid) == 7, "thread_join");
+  CHECK (thread_join (tid) == -1, "thread_join again");
+}
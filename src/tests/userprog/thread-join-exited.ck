@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-join-exited) begin
+(thread-join-exited) thread_create
+(thread-join-exited) thread_join
+(thread-join-exited) thread_join again
+(thread-join-exited) end
+thread-join-exited: exit(0)
+EOF
+pass;
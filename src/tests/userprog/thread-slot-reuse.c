@@ -0,0 +1,52 @@
+/* Fills every stack slot of the process with threads, checks
+   that one more cannot be created, then joins them all and
+   checks that their slots can be used again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* One fewer than the kernel's PROCESS_THREAD_MAX, since the
+   first thread has a slot too. */
+#define THREAD_CNT 31
+
+static int gate;
+
+static int
+waiter (void *n_) 
+{
+  while (gate == 0)
+    futex_wait (&gate, 0);
+  return (int) n_;
+}
+
+/* Starts THREAD_CNT threads, checks that no more fit, then lets
+   them exit and joins them. */
+static void
+fill_slots (void) 
+{
+  tid_t tids[THREAD_CNT];
+  int i;
+
+  gate = 0;
+  for (i = 0; i < THREAD_CNT; i++)
+    if ((tids[i] = thread_create (waiter, (void *) i)) == TID_ERROR)
+      fail ("thread_create %d failed", i);
+  if (thread_create (waiter, NULL) != TID_ERROR)
+    fail ("thread_create succeeded with every slot in use");
+
+  gate = 1;
+  futex_wake (&gate, THREAD_CNT);
+  for (i = 0; i < THREAD_CNT; i++)
+    if (thread_join (tids[i]) != i)
+      fail ("thread %d exited with wrong status", i);
+}
+
+void
+test_main (void) 
+{
+  fill_slots ();
+  msg ("filled every slot once");
+  fill_slots ();
+  msg ("filled every slot again");
+}
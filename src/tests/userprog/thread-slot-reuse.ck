@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-slot-reuse) begin
+(thread-slot-reuse) filled every slot once
+(thread-slot-reuse) filled every slot again
+(thread-slot-reuse) end
+thread-slot-reuse: exit(0)
+EOF
+pass;
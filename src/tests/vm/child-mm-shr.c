@@ -0,0 +1,22 @@
+/* Child process of mmap-shared.
+   Maps the file that its parent has mapped and written, checks
+   that it sees the parent's write before the parent unmaps the
+   file, and writes a reply for the parent to see. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK ((handle = open ("shared.dat")) > 1, "open \"shared.dat\"");
+  CHECK (mmap (handle, ACTUAL) != MAP_FAILED, "mmap \"shared.dat\"");
+  CHECK (!strcmp (ACTUAL, "from parent"), "see parent's write");
+  strlcpy (ACTUAL + 100, "from child", 50);
+}
@@ -0,0 +1,48 @@
+/* Forks, then has parent and child each overwrite a buffer that
+   they share copy-on-write, and checks that neither sees the
+   other's writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 4096)
+
+static char buf[SIZE];
+
+/* Fails unless every byte of BUF is C. */
+static void
+check_buf (char c, const char *who) 
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      fail ("%s: byte %zu is '%c', expected '%c'", who, i, buf[i], c);
+}
+
+void
+test_main (void) 
+{
+  pid_t child;
+
+  memset (buf, 'a', SIZE);
+  msg ("fork");
+  child = fork ();
+  if (child == 0)
+    {
+      /* Whatever the parent writes, we must still see 'a'. */
+      check_buf ('a', "child");
+      memset (buf, 'c', SIZE);
+      check_buf ('c', "child");
+      exit (81);
+    }
+  if (child == PID_ERROR)
+    fail ("fork failed");
+
+  memset (buf, 'p', SIZE);
+  CHECK (wait (child) == 81, "wait for child");
+  check_buf ('p', "parent");
+  msg ("parent's buffer unchanged by child");
+}
@@ -0,0 +1,43 @@
+/* Forks with a file mapped, then has parent and child both write
+   to the same page of the mapping.  Checks that the parent sees
+   the child's write, and that the file gets both. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+void
+test_main (void) 
+{
+  static char expected[512];
+  mapid_t map;
+  pid_t child;
+  int handle;
+
+  CHECK (create ("fork.dat", sizeof expected), "create \"fork.dat\"");
+  CHECK ((handle = open ("fork.dat")) > 1, "open \"fork.dat\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"fork.dat\"");
+
+  msg ("fork");
+  child = fork ();
+  if (child == 0)
+    {
+      strlcpy (ACTUAL, "from child", 50);
+      exit (83);
+    }
+  if (child == PID_ERROR)
+    fail ("fork failed");
+
+  strlcpy (ACTUAL + 100, "from parent", 50);
+  CHECK (wait (child) == 83, "wait for child");
+  CHECK (!strcmp (ACTUAL, "from child"), "see child's write");
+
+  munmap (map);
+  strlcpy (expected, "from child", 50);
+  strlcpy (expected + 100, "from parent", 50);
+  check_file_handle (handle, "fork.dat", expected, sizeof expected);
+  close (handle);
+}
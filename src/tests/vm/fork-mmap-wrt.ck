@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-mmap-wrt) begin
+(fork-mmap-wrt) create "fork.dat"
+(fork-mmap-wrt) open "fork.dat"
+(fork-mmap-wrt) mmap "fork.dat"
+(fork-mmap-wrt) fork
+(fork-mmap-wrt) wait for child
+(fork-mmap-wrt) see child's write
+(fork-mmap-wrt) verified contents of "fork.dat"
+(fork-mmap-wrt) end
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Forks with a file mapped, checks that the child inherits the
+   mapping, and that the child unmapping it leaves the parent's
+   mapping alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void) 
+{
+  mapid_t map;
+  pid_t child;
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  msg ("fork");
+  child = fork ();
+  if (child == 0)
+    {
+      if (memcmp (ACTUAL, sample, strlen (sample)))
+        fail ("child: read of mmap'd file reported bad data");
+      munmap (map);
+      exit (83);
+    }
+  if (child == PID_ERROR)
+    fail ("fork failed");
+
+  CHECK (wait (child) == 83, "wait for child");
+  if (memcmp (ACTUAL, sample, strlen (sample)))
+    fail ("parent: read of mmap'd file reported bad data");
+  munmap (map);
+  msg ("parent's mapping survived child's munmap");
+}
@@ -0,0 +1,53 @@
+/* Fills a buffer too big to stay in memory, so that much of it
+   is in swap when the process forks.  The child checks its copy,
+   and rewrites it, which keeps memory short while the parent
+   checks that its own copy is unchanged. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+static unsigned char buf[SIZE];
+
+/* Fails unless byte I of BUF is I * MUL + ADD, truncated. */
+static void
+check_buf (unsigned mul, unsigned add, const char *who) 
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (unsigned char) (i * mul + add))
+      fail ("%s: byte %zu is %d, expected %d",
+            who, i, buf[i], (unsigned char) (i * mul + add));
+}
+
+void
+test_main (void) 
+{
+  pid_t child;
+  size_t i;
+
+  msg ("initialize");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i * 7 + 1;
+
+  msg ("fork");
+  child = fork ();
+  if (child == 0)
+    {
+      check_buf (7, 1, "child");
+      for (i = 0; i < SIZE; i++)
+        buf[i] = i * 3 + 2;
+      check_buf (3, 2, "child");
+      exit (82);
+    }
+  if (child == PID_ERROR)
+    fail ("fork failed");
+
+  check_buf (7, 1, "parent");
+  CHECK (wait (child) == 82, "wait for child");
+  check_buf (7, 1, "parent");
+  msg ("parent's buffer unchanged by child");
+}
@@ -0,0 +1,48 @@
+/* Writes to a file through a mapping, then touches enough other
+   memory to force the mapped pages out, and verifies through the
+   mapping that they were written back to the file and read in
+   again intact.  Then unmaps the file and verifies it with the
+   read system call. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define FILE_SIZE (128 * 1024)
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+static char expected[FILE_SIZE];
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  for (i = 0; i < FILE_SIZE; i++)
+    expected[i] = i * 7 + i / 4096;
+
+  CHECK (create ("large.dat", FILE_SIZE), "create \"large.dat\"");
+  CHECK ((handle = open ("large.dat")) > 1, "open \"large.dat\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"large.dat\"");
+  msg ("write through mapping");
+  memcpy (ACTUAL, expected, FILE_SIZE);
+
+  msg ("force mapped pages out");
+  memset (buf, 0x5a, sizeof buf);
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0x5a)
+      fail ("byte %zu != 0x5a", i);
+
+  if (memcmp (ACTUAL, expected, FILE_SIZE))
+    fail ("read of mmap'd file reported bad data");
+  msg ("mapping survived eviction");
+
+  munmap (map);
+  check_file_handle (handle, "large.dat", expected, FILE_SIZE);
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-evict) begin
+(mmap-evict) create "large.dat"
+(mmap-evict) open "large.dat"
+(mmap-evict) mmap "large.dat"
+(mmap-evict) write through mapping
+(mmap-evict) force mapped pages out
+(mmap-evict) mapping survived eviction
+(mmap-evict) verified contents of "large.dat"
+(mmap-evict) end
+EOF
+pass;
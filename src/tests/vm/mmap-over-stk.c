@@ -0,0 +1,21 @@
+/* Verifies that mapping over the stack segment is disallowed,
+   even below the part of it that the stack has grown into. */
+
+#include <stdint.h>
+#include <round.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int handle;
+  uintptr_t handle_page = ROUND_DOWN ((uintptr_t) &handle, 4096);
+  
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, (void *) handle_page) == MAP_FAILED,
+         "try to mmap over stack segment");
+  CHECK (mmap (handle, (void *) 0xbff80000) == MAP_FAILED,
+         "try to mmap below stack segment");
+}
@@ -0,0 +1,38 @@
+/* Maps a file and writes to it, then executes child-mm-shr,
+   which maps the same file and must see the write without our
+   unmapping it first.  The child writes a reply, which we must
+   see through our mapping once it has exited, and which must
+   reach the file when we unmap it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  static char expected[512];
+  int handle;
+  mapid_t map;
+  pid_t child;
+
+  CHECK (create ("shared.dat", sizeof expected), "create \"shared.dat\"");
+  CHECK ((handle = open ("shared.dat")) > 1, "open \"shared.dat\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"shared.dat\"");
+  strlcpy (ACTUAL, "from parent", 50);
+
+  quiet = true;
+  CHECK ((child = exec ("child-mm-shr")) != -1, "exec \"child-mm-shr\"");
+  CHECK (wait (child) == 0, "wait for child (should return 0)");
+  quiet = false;
+  CHECK (!strcmp (ACTUAL + 100, "from child"), "see child's write");
+
+  munmap (map);
+  strlcpy (expected, "from parent", 50);
+  strlcpy (expected + 100, "from child", 50);
+  check_file_handle (handle, "shared.dat", expected, sizeof expected);
+  close (handle);
+}
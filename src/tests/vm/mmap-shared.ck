@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-shared) begin
+(mmap-shared) create "shared.dat"
+(mmap-shared) open "shared.dat"
+(mmap-shared) mmap "shared.dat"
+(child-mm-shr) begin
+(child-mm-shr) open "shared.dat"
+(child-mm-shr) mmap "shared.dat"
+(child-mm-shr) see parent's write
+(child-mm-shr) end
+(mmap-shared) see child's write
+(mmap-shared) verified contents of "shared.dat"
+(mmap-shared) end
+EOF
+pass;
@@ -0,0 +1,31 @@
+#ifndef THREADS_AP_START_H
+#define THREADS_AP_START_H
+
+/* Physical address to which the application processor startup
+   code in ap-start.S is copied, and at which the application
+   processors start running in real mode.  It must be
+   page-aligned and in the first megabyte.  This page is free:
+   the loader and its arguments are below it, the initial
+   thread's page is at 0xe000, and the page allocator only hands
+   out memory above 1 MB. */
+#define AP_START_PADDR 0x8000
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+/* Arguments for the startup code, filled in, in the copy at
+   AP_START_PADDR, before each application processor is started.
+   The layout must match the end of ap-start.S. */
+struct ap_start_args
+  {
+    uint32_t pd;                /* Physical address of page directory. */
+    void *esp;                  /* Initial stack pointer. */
+    void (*entry) (void);       /* Function to call. */
+  };
+
+/* Startup code, and its arguments, which lie within it. */
+extern const char ap_start[], ap_start_end[];
+extern const struct ap_start_args ap_start_args;
+#endif
+
+#endif /* threads/ap-start.h */
@@ -0,0 +1,314 @@
+#include "threads/apic.h"
+#include <debug.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Local and I/O Advanced Programmable Interrupt Controllers.
+
+   Each processor has a local APIC, which delivers interrupts to
+   it, sends interprocessor interrupts (IPIs) to the others, and
+   has a timer of its own.  An I/O APIC takes the place of the
+   PICs: it routes each device's interrupt line to a chosen
+   vector on a chosen processor.
+
+   Both are programmed through memory-mapped registers, which
+   apic_init() maps at virtual addresses equal to their physical
+   addresses, with caching disabled.
+
+   See [IA32-v3a] chapter 8 "Advanced Programmable Interrupt
+   Controller (APIC)" for the local APIC, and the Intel 82093AA
+   I/O APIC datasheet for the I/O APIC. */
+
+/* Local APIC registers, as byte offsets. */
+#define LAPIC_ID        0x020   /* Local APIC ID. */
+#define LAPIC_TPR       0x080   /* Task priority. */
+#define LAPIC_EOI       0x0b0   /* End of interrupt. */
+#define LAPIC_SVR       0x0f0   /* Spurious interrupt vector. */
+#define LAPIC_ESR       0x280   /* Error status. */
+#define LAPIC_ICR_LO    0x300   /* Interrupt command, low word. */
+#define LAPIC_ICR_HI    0x310   /* Interrupt command, high word. */
+#define LAPIC_LVT_TIMER 0x320   /* Local vector table: timer. */
+#define LAPIC_LVT_LINT0 0x350   /* Local vector table: LINT0 pin. */
+#define LAPIC_LVT_LINT1 0x360   /* Local vector table: LINT1 pin. */
+#define LAPIC_LVT_ERROR 0x370   /* Local vector table: errors. */
+#define LAPIC_TIMER_ICR 0x380   /* Timer initial count. */
+#define LAPIC_TIMER_CCR 0x390   /* Timer current count. */
+#define LAPIC_TIMER_DCR 0x3e0   /* Timer divide configuration. */
+
+/* Local APIC register bits. */
+#define SVR_ENABLE      0x00100 /* APIC software enable. */
+#define LVT_MASKED      0x10000 /* Interrupt masked. */
+#define LVT_PERIODIC    0x20000 /* Timer: periodic, not one-shot. */
+#define DM_NMI          0x00400 /* Delivery mode: NMI. */
+#define DM_INIT         0x00500 /* Delivery mode: INIT. */
+#define DM_STARTUP      0x00600 /* Delivery mode: startup IPI. */
+#define DM_EXTINT       0x00700 /* Delivery mode: from the PIC. */
+#define ICR_PENDING     0x01000 /* IPI not yet accepted. */
+#define ICR_ASSERT      0x04000 /* Level: assert, not deassert. */
+#define ICR_LEVEL       0x08000 /* Level-, not edge-triggered. */
+#define DCR_DIV16       0x3     /* Timer counts every 16 bus cycles. */
+
+/* I/O APIC registers.  The I/O APIC has only two memory-mapped
+   registers, a register selector and a window onto the selected
+   register. */
+#define IOAPIC_REGSEL   0       /* Register selector, as word index. */
+#define IOAPIC_WIN      4       /* Data window, as word index. */
+#define IOAPIC_VER      0x01    /* Version and redirection entry count. */
+#define IOAPIC_REDTBL   0x10    /* Redirection table, 2 registers/pin. */
+
+/* I/O APIC redirection entry bits. */
+#define REDIR_MASKED    0x10000 /* Interrupt masked. */
+#define REDIR_LEVEL     0x08000 /* Level-, not edge-triggered. */
+#define REDIR_LOW       0x02000 /* Active low, not active high. */
+
+/* Registers, mapped by apic_init(). */
+static volatile uint32_t *lapic;
+static volatile uint32_t *ioapic;
+
+/* Local APIC timer count per timer tick, from
+   lapic_timer_calibrate(). */
+static uint32_t lapic_timer_count;
+
+static void *map_mmio (uint32_t paddr);
+static void lapic_write (unsigned reg, uint32_t value);
+static uint32_t lapic_read (unsigned reg);
+static void lapic_send (uint8_t apic_id, uint32_t icr);
+static void ioapic_write (unsigned reg, uint32_t value);
+static uint32_t ioapic_read (unsigned reg);
+
+/* Maps the local APIC registers at LAPIC_PADDR and the I/O
+   APIC registers at IOAPIC_PADDR into the kernel's page tables.
+   Must be called before any process's page directory is
+   created, since those copy the kernel's mappings. */
+void
+apic_init (uint32_t lapic_paddr, uint32_t ioapic_paddr)
+{
+  lapic = map_mmio (lapic_paddr);
+  ioapic = map_mmio (ioapic_paddr);
+}
+
+/* Maps the page at physical address PADDR, which must be above
+   all of RAM, to the same virtual address in init_page_dir, as
+   an uncached kernel page, and returns the virtual address. */
+static void *
+map_mmio (uint32_t paddr)
+{
+  void *vaddr = (void *) paddr;
+  uint32_t *pde = &init_page_dir[pd_no (vaddr)];
+  uint32_t *pt;
+
+  ASSERT (pg_ofs (vaddr) == 0);
+  ASSERT (vaddr >= ptov (init_ram_pages * PGSIZE));
+
+  if (*pde == 0)
+    *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+  pt = pde_get_pt (*pde);
+  pt[pt_no (vaddr)] = paddr | PTE_P | PTE_W | PTE_PCD | PTE_PWT;
+  return vaddr;
+}
+
+/* Local APIC. */
+
+/* Sets up the running processor's local APIC, which is the
+   bootstrap processor's if BSP is true.  The APIC's timer is
+   left off, with interrupts off.
+
+   On the bootstrap processor the PICs stay wired through LINT0
+   as "virtual wire" interrupts, and NMIs come in on LINT1,
+   until the I/O APIC takes over.  Other processors ignore both
+   pins. */
+void
+lapic_init (bool bsp)
+{
+  ASSERT (lapic != NULL);
+
+  lapic_write (LAPIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VEC);
+  lapic_write (LAPIC_LVT_TIMER, LVT_MASKED | APIC_TIMER_VEC);
+  lapic_write (LAPIC_LVT_LINT0, bsp ? DM_EXTINT : LVT_MASKED);
+  lapic_write (LAPIC_LVT_LINT1, bsp ? DM_NMI : LVT_MASKED);
+  lapic_write (LAPIC_LVT_ERROR, LVT_MASKED);
+
+  /* The error status register must be written before it is
+     read, so clear it twice: once to latch, once to clear. */
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_ESR, 0);
+
+  /* Acknowledge any outstanding interrupt and accept them all. */
+  lapic_write (LAPIC_EOI, 0);
+  lapic_write (LAPIC_TPR, 0);
+}
+
+/* Returns the running processor's local APIC ID. */
+uint8_t
+lapic_id (void)
+{
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Signals the end of the interrupt being handled to the running
+   processor's local APIC, which will not deliver another
+   interrupt of the same or lower priority until it is told. */
+void
+lapic_eoi (void)
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends an interrupt with vector VEC to the processor whose
+   local APIC ID is APIC_ID. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec)
+{
+  lapic_send (apic_id, vec);
+}
+
+/* Starts the application processor with local APIC ID APIC_ID
+   executing in real mode at PADDR, which must be a page-aligned
+   address in the first megabyte, using the INIT-SIPI-SIPI
+   sequence of the MultiProcessor Specification, appendix B.4.
+   Must be called with interrupts on, because of the delays. */
+void
+lapic_start_ap (uint8_t apic_id, uint32_t paddr)
+{
+  uint16_t *warm_reset = ptov (0x467);
+
+  ASSERT (paddr % PGSIZE == 0 && paddr < 0x100000);
+
+  /* Older processors start at the BIOS's warm reset vector
+     instead of the startup IPI's address.  Setting the CMOS
+     shutdown code to 0x0a makes the BIOS jump there. */
+  outb (0x70, 0x0f);
+  outb (0x71, 0x0a);
+  warm_reset[0] = 0;
+  warm_reset[1] = paddr >> 4;
+
+  lapic_send (apic_id, DM_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_udelay (200);
+  lapic_send (apic_id, DM_INIT | ICR_LEVEL);
+  timer_mdelay (10);
+
+  lapic_send (apic_id, DM_STARTUP | (paddr >> 12));
+  timer_udelay (200);
+  lapic_send (apic_id, DM_STARTUP | (paddr >> 12));
+  timer_udelay (200);
+}
+
+/* Measures how fast the local APIC timer counts, against the
+   PIT's timer ticks, so that lapic_timer_start() can make it
+   interrupt once per tick.  The timer interrupt must be on. */
+void
+lapic_timer_calibrate (void)
+{
+  int64_t start;
+  uint32_t count;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  lapic_write (LAPIC_TIMER_DCR, DCR_DIV16);
+  lapic_write (LAPIC_LVT_TIMER, LVT_MASKED | APIC_TIMER_VEC);
+
+  /* Wait for a tick boundary, then count down through 4 ticks. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+  lapic_write (LAPIC_TIMER_ICR, UINT32_MAX);
+  start = timer_ticks ();
+  while (timer_elapsed (start) < 4)
+    barrier ();
+  count = UINT32_MAX - lapic_read (LAPIC_TIMER_CCR);
+  lapic_write (LAPIC_TIMER_ICR, 0);
+
+  lapic_timer_count = count / 4 > 0 ? count / 4 : 1;
+}
+
+/* Starts the running processor's local APIC timer interrupting
+   on APIC_TIMER_VEC once per timer tick. */
+void
+lapic_timer_start (void)
+{
+  ASSERT (lapic_timer_count != 0);
+
+  lapic_write (LAPIC_TIMER_DCR, DCR_DIV16);
+  lapic_write (LAPIC_LVT_TIMER, LVT_PERIODIC | APIC_TIMER_VEC);
+  lapic_write (LAPIC_TIMER_ICR, lapic_timer_count);
+}
+
+/* Writes VALUE to local APIC register REG. */
+static void
+lapic_write (unsigned reg, uint32_t value)
+{
+  lapic[reg / sizeof *lapic] = value;
+
+  /* Reading a register waits for the write to finish. */
+  lapic[LAPIC_ID / sizeof *lapic];
+}
+
+/* Returns the value of local APIC register REG. */
+static uint32_t
+lapic_read (unsigned reg)
+{
+  return lapic[reg / sizeof *lapic];
+}
+
+/* Sends an IPI with interrupt command ICR, whose low word is
+   ICR, to the processor whose local APIC ID is APIC_ID, and
+   waits for its local APIC to accept it. */
+static void
+lapic_send (uint8_t apic_id, uint32_t icr)
+{
+  enum intr_level old_level = intr_disable ();
+
+  lapic_write (LAPIC_ICR_HI, (uint32_t) apic_id << 24);
+  lapic_write (LAPIC_ICR_LO, icr);
+  while (lapic_read (LAPIC_ICR_LO) & ICR_PENDING)
+    asm volatile ("pause");
+
+  intr_set_level (old_level);
+}
+
+/* I/O APIC. */
+
+/* Returns the number of interrupt input pins on the I/O APIC. */
+size_t
+ioapic_pin_cnt (void)
+{
+  return ((ioapic_read (IOAPIC_VER) >> 16) & 0xff) + 1;
+}
+
+/* Routes I/O APIC input PIN to vector VEC on the processor whose
+   local APIC ID is APIC_ID.  The input is active low if
+   ACTIVE_LOW is true and level-triggered if LEVEL is true. */
+void
+ioapic_route (size_t pin, uint8_t vec, bool active_low, bool level,
+              uint8_t apic_id)
+{
+  ASSERT (pin < ioapic_pin_cnt ());
+
+  ioapic_write (IOAPIC_REDTBL + 2 * pin + 1, (uint32_t) apic_id << 24);
+  ioapic_write (IOAPIC_REDTBL + 2 * pin,
+                vec | (active_low ? REDIR_LOW : 0) | (level ? REDIR_LEVEL : 0));
+}
+
+/* Writes VALUE to I/O APIC register REG. */
+static void
+ioapic_write (unsigned reg, uint32_t value)
+{
+  ioapic[IOAPIC_REGSEL] = reg;
+  ioapic[IOAPIC_WIN] = value;
+}
+
+/* Returns the value of I/O APIC register REG. */
+static uint32_t
+ioapic_read (unsigned reg)
+{
+  ioapic[IOAPIC_REGSEL] = reg;
+  return ioapic[IOAPIC_WIN];
+}
@@ -0,0 +1,33 @@
+#ifndef THREADS_APIC_H
+#define THREADS_APIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Interrupt vectors raised through the local APICs.  They are
+   above every vector used otherwise, including the system call
+   vector 0x30. */
+#define APIC_VEC_MIN 0xf0
+#define APIC_TIMER_VEC 0xf0     /* Local APIC timer. */
+#define APIC_RESCHED_VEC 0xf1   /* "Run your scheduler" IPI. */
+#define APIC_TLB_VEC 0xf2       /* "Flush your TLB" IPI. */
+#define APIC_SPURIOUS_VEC 0xff  /* Spurious interrupt. */
+
+void apic_init (uint32_t lapic_paddr, uint32_t ioapic_paddr);
+
+/* Local APIC. */
+void lapic_init (bool bsp);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uint32_t paddr);
+void lapic_timer_calibrate (void);
+void lapic_timer_start (void);
+
+/* I/O APIC. */
+size_t ioapic_pin_cnt (void);
+void ioapic_route (size_t pin, uint8_t vec, bool active_low, bool level,
+                   uint8_t apic_id);
+
+#endif /* threads/apic.h */
@@ -0,0 +1,606 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/ap-start.h"
+#include "threads/apic.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Processor detection through the MultiProcessor Specification
+   tables.
+
+   The BIOS describes the processors and APICs in a machine with
+   an "MP floating pointer structure", found by a signature scan
+   of low memory, that points to an "MP configuration table"
+   with one entry per processor, bus, I/O APIC, and interrupt
+   source.  Both QEMU (with -smp) and Bochs provide these tables.
+
+   See chapter 4 of the Intel MultiProcessor Specification,
+   version 1.4, for the layout of the tables. */
+
+/* MP floating pointer structure. */
+struct mp_fp
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config_paddr;      /* Physical address of config table. */
+    uint8_t length;             /* Length in 16-byte units (1). */
+    uint8_t spec_rev;           /* MP spec revision. */
+    uint8_t checksum;           /* Makes all bytes sum to 0. */
+    uint8_t type;               /* Nonzero for a default configuration. */
+    uint8_t features[4];        /* Feature bytes. */
+  } __attribute__ ((packed));
+
+/* Set in features[0] if the PICs are connected to the processors
+   through an Interrupt Mode Configuration Register, which must
+   be switched over to hand interrupts to the APICs instead. */
+#define MP_FP_IMCR 0x80
+
+/* MP configuration table header. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of base table, in bytes. */
+    uint8_t spec_rev;           /* MP spec revision. */
+    uint8_t checksum;           /* Makes all bytes sum to 0. */
+    char oem_id[8];             /* Manufacturer. */
+    char product_id[12];        /* Product family. */
+    uint32_t oem_table_paddr;   /* Optional OEM table, or 0. */
+    uint16_t oem_table_size;    /* Size of OEM table. */
+    uint16_t entry_cnt;         /* Number of entries that follow. */
+    uint32_t lapic_paddr;       /* Local APIC address. */
+    uint16_t ext_length;        /* Length of extended entries. */
+    uint8_t ext_checksum;       /* Checksum of extended entries. */
+    uint8_t reserved;
+  } __attribute__ ((packed));
+
+/* MP configuration table entry types. */
+enum mp_entry_type
+  {
+    MP_PROCESSOR = 0,           /* Processor, 20 bytes. */
+    MP_BUS = 1,                 /* Bus, 8 bytes. */
+    MP_IOAPIC = 2,              /* I/O APIC, 8 bytes. */
+    MP_IOINTR = 3,              /* I/O interrupt assignment, 8 bytes. */
+    MP_LINTR = 4                /* Local interrupt assignment, 8 bytes. */
+  };
+
+/* Processor entry. */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;       /* Local APIC version. */
+    uint8_t flags;              /* MP_PROC_* flags. */
+    uint32_t signature;         /* CPU stepping, model, family. */
+    uint32_t features;          /* CPUID feature flags. */
+    uint32_t reserved[2];
+  } __attribute__ ((packed));
+
+#define MP_PROC_ENABLED 0x01    /* Processor is usable. */
+#define MP_PROC_BSP 0x02        /* Processor is the bootstrap processor. */
+
+/* Bus entry. */
+struct mp_bus
+  {
+    uint8_t type;               /* MP_BUS. */
+    uint8_t bus_id;             /* Bus ID, used by MP_IOINTR entries. */
+    char bus_type[6];           /* Bus type, e.g. "ISA   ". */
+  } __attribute__ ((packed));
+
+/* I/O APIC entry. */
+struct mp_ioapic
+  {
+    uint8_t type;               /* MP_IOAPIC. */
+    uint8_t apic_id;            /* I/O APIC ID. */
+    uint8_t apic_version;       /* I/O APIC version. */
+    uint8_t flags;              /* Bit 0 set if usable. */
+    uint32_t paddr;             /* I/O APIC address. */
+  } __attribute__ ((packed));
+
+/* I/O interrupt assignment entry, which says which I/O APIC pin
+   a bus's interrupt source is wired to. */
+struct mp_iointr
+  {
+    uint8_t type;               /* MP_IOINTR. */
+    uint8_t intr_type;          /* 0 for a vectored interrupt. */
+    uint16_t flags;             /* MP_IRQ_* polarity and trigger mode. */
+    uint8_t src_bus;            /* Source bus ID. */
+    uint8_t src_irq;            /* Source bus IRQ. */
+    uint8_t dst_apic_id;        /* Destination I/O APIC ID, or 0xff. */
+    uint8_t dst_pin;            /* Destination I/O APIC pin. */
+  } __attribute__ ((packed));
+
+/* Polarity and trigger mode in mp_iointr's flags.  The default
+   for an ISA interrupt is active high and edge-triggered. */
+#define MP_IRQ_POLARITY 0x3     /* Polarity mask. */
+#define MP_IRQ_LOW 0x3          /* Polarity: active low. */
+#define MP_IRQ_TRIGGER 0xc      /* Trigger mode mask. */
+#define MP_IRQ_LEVEL 0xc        /* Trigger mode: level. */
+
+struct cpu cpus[CPU_MAX];
+size_t cpu_cnt = 1;
+size_t cpu_present_cnt = 1;
+uint32_t lapic_paddr;
+uint32_t ioapic_paddr;
+
+/* Number of application processors recorded in cpus[], which
+   cpu_start() tries to start. */
+static size_t ap_cnt;
+
+/* Routing of the 16 ISA interrupts to the first I/O APIC, from
+   the MP configuration table's interrupt assignment entries. */
+struct isa_irq
+  {
+    bool assigned;              /* Entry found for this IRQ? */
+    uint8_t pin;                /* I/O APIC pin. */
+    uint16_t flags;             /* MP_IRQ_* flags. */
+  };
+static struct isa_irq isa_irqs[16];
+static uint8_t ioapic_id;       /* ID of the first I/O APIC. */
+static bool imcr_present;       /* Need to switch the IMCR? */
+
+/* Time-stamp counter at cpu_init(), just before the timer
+   starts ticking. */
+static uint64_t boot_tsc;
+
+/* GDTR contents on the bootstrap processor, for application
+   processors to load. */
+static uint64_t boot_gdtr;
+
+static void route_isa_irqs (void);
+static void cpu_ap_main (void) NO_RETURN;
+static intr_handler_func lapic_timer_interrupt;
+static intr_handler_func resched_interrupt;
+static intr_handler_func tlb_interrupt;
+static struct mp_fp *mp_search (void);
+static struct mp_fp *mp_search_range (uintptr_t paddr, size_t size);
+static bool checksum_ok (const void *, size_t size);
+
+/* Detects the processors in the system by reading the MP
+   configuration table, and records the APIC IDs of the
+   processors, the addresses of the local and I/O APICs, and the
+   I/O APIC pins that the ISA interrupts are wired to.
+
+   If there is more than one processor, and the APICs needed to
+   start the others are present, maps the APICs' registers, so
+   that cpu_start() can start the others later.  This must happen
+   before any process's page directory is created. */
+void
+cpu_init (void)
+{
+  struct mp_fp *fp = mp_search ();
+  struct mp_config *conf;
+  bool isa_bus[256];
+  uint8_t *p, *end;
+  size_t i;
+
+  boot_tsc = cpu_rdtsc ();
+
+  if (fp == NULL || fp->config_paddr == 0 || fp->type != 0)
+    {
+      printf ("cpu: no MP configuration table, assuming 1 CPU\n");
+      return;
+    }
+
+  conf = ptov (fp->config_paddr);
+  if (memcmp (conf->signature, "PCMP", 4)
+      || !checksum_ok (conf, conf->length))
+    {
+      printf ("cpu: bad MP configuration table, assuming 1 CPU\n");
+      return;
+    }
+  lapic_paddr = conf->lapic_paddr;
+  imcr_present = (fp->features[0] & MP_FP_IMCR) != 0;
+
+  /* The table lists its entries sorted by type, so the buses and
+     I/O APICs are known by the time the interrupt assignments
+     that refer to them come along. */
+  cpu_present_cnt = 0;
+  memset (isa_bus, 0, sizeof isa_bus);
+  p = (uint8_t *) (conf + 1);
+  end = (uint8_t *) conf + conf->length;
+  for (i = 0; i < conf->entry_cnt && p < end; i++)
+    {
+      switch (*p)
+        {
+        case MP_PROCESSOR:
+          {
+            struct mp_processor *proc = (struct mp_processor *) p;
+            if (proc->flags & MP_PROC_ENABLED)
+              {
+                /* The bootstrap processor, which is running this
+                   code, is always cpus[0]. */
+                if (proc->flags & MP_PROC_BSP)
+                  cpus[0].apic_id = proc->apic_id;
+                else if (1 + ap_cnt < CPU_MAX)
+                  cpus[1 + ap_cnt++].apic_id = proc->apic_id;
+                cpu_present_cnt++;
+              }
+            p += sizeof *proc;
+          }
+          break;
+
+        case MP_BUS:
+          {
+            struct mp_bus *bus = (struct mp_bus *) p;
+            if (!memcmp (bus->bus_type, "ISA   ", sizeof bus->bus_type))
+              isa_bus[bus->bus_id] = true;
+            p += sizeof *bus;
+          }
+          break;
+
+        case MP_IOAPIC:
+          {
+            struct mp_ioapic *ioapic = (struct mp_ioapic *) p;
+            if ((ioapic->flags & 1) && ioapic_paddr == 0)
+              {
+                ioapic_paddr = ioapic->paddr;
+                ioapic_id = ioapic->apic_id;
+              }
+            p += sizeof *ioapic;
+          }
+          break;
+
+        case MP_IOINTR:
+          {
+            struct mp_iointr *intr = (struct mp_iointr *) p;
+            if (intr->intr_type == 0 && isa_bus[intr->src_bus]
+                && intr->src_irq < 16 && ioapic_paddr != 0
+                && (intr->dst_apic_id == ioapic_id
+                    || intr->dst_apic_id == 0xff))
+              {
+                struct isa_irq *irq = &isa_irqs[intr->src_irq];
+                irq->assigned = true;
+                irq->pin = intr->dst_pin;
+                irq->flags = intr->flags;
+              }
+            p += sizeof *intr;
+          }
+          break;
+
+        case MP_LINTR:
+          p += 8;
+          break;
+
+        default:
+          printf ("cpu: unknown MP table entry type %d\n", *p);
+          i = conf->entry_cnt;
+          break;
+        }
+    }
+  if (cpu_present_cnt == 0)
+    cpu_present_cnt = 1;
+
+  printf ("cpu: %zu CPU%s present "
+          "(local APIC at %#"PRIx32", I/O APIC at %#"PRIx32")\n",
+          cpu_present_cnt, cpu_present_cnt != 1 ? "s" : "",
+          lapic_paddr, ioapic_paddr);
+
+  if (ap_cnt > 0 && lapic_paddr != 0 && ioapic_paddr != 0)
+    apic_init (lapic_paddr, ioapic_paddr);
+  else
+    ap_cnt = 0;
+}
+
+/* Starts the application processors found by cpu_init(), if
+   any.  Must be called by the bootstrap processor with
+   interrupts on, once the timer has been calibrated.
+
+   Switching from one CPU to several takes these steps:
+
+     - The local APIC timer is calibrated against the PIT, so
+       that the application processors, which do not receive
+       the PIT's interrupts, can tick at the same rate.
+
+     - The I/O APIC takes over from the PICs, still delivering
+       every device interrupt to the bootstrap processor.
+
+     - The interrupt lock is switched on (see interrupt.c), so
+       that data protected by disabling interrupts stays
+       protected with more than one CPU.
+
+     - Each application processor is sent the INIT-SIPI-SIPI
+       sequence, which makes it run the code in ap-start.S and
+       then cpu_ap_main() on the stack of its own idle thread.
+       We wait up to a second for it to come online. */
+void
+cpu_start (void)
+{
+  struct ap_start_args *args;
+  enum intr_level old_level;
+  uint32_t *pd;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (ap_cnt == 0)
+    return;
+
+  old_level = intr_disable ();
+  cpus[0].apic_id = lapic_id ();
+  lapic_init (true);
+  intr_set_level (old_level);
+  lapic_timer_calibrate ();
+
+  intr_register_ext (APIC_TIMER_VEC, lapic_timer_interrupt,
+                     "Local APIC Timer");
+  intr_register_ext (APIC_RESCHED_VEC, resched_interrupt, "Reschedule IPI");
+  intr_register_ipi (APIC_TLB_VEC, tlb_interrupt, "TLB Shootdown IPI");
+
+  old_level = intr_disable ();
+  route_isa_irqs ();
+  if (imcr_present)
+    {
+      /* Select the IMCR, then connect the processors' interrupt
+         lines to the APICs instead of the PICs. */
+      outb (0x22, 0x70);
+      outb (0x23, 0x01);
+    }
+  intr_use_apic ();
+  intr_lock_start ();
+  intr_set_level (old_level);
+
+  /* The startup code runs with a copy of the kernel's page
+     directory that also maps the first 4 MB of physical memory at
+     virtual address 0, where the startup code lies, because it
+     turns on paging before jumping to the kernel. */
+  pd = palloc_get_page (PAL_ASSERT);
+  memcpy (pd, init_page_dir, PGSIZE);
+  pd[0] = init_page_dir[pd_no (PHYS_BASE)];
+  memcpy (ptov (AP_START_PADDR), ap_start, ap_start_end - ap_start);
+  args = ptov (AP_START_PADDR + ((const char *) &ap_start_args - ap_start));
+  asm volatile ("sgdt %0" : "=m" (boot_gdtr));
+
+  for (i = 1; i <= ap_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+      struct thread *t = thread_prepare_ap (c);
+      int ms;
+
+      args->pd = vtop (pd);
+      args->esp = (uint8_t *) t + PGSIZE;
+      args->entry = cpu_ap_main;
+      lapic_start_ap (c->apic_id, AP_START_PADDR);
+      for (ms = 0; ms < 1000 && cpu_cnt <= c->id; ms += 10)
+        timer_msleep (10);
+      if (cpu_cnt <= c->id)
+        {
+          /* It might still come along later and use PD, so PD
+             is not freed. */
+          printf ("cpu: CPU %u (APIC ID %"PRIu8") did not start\n",
+                  c->id, c->apic_id);
+          return;
+        }
+    }
+  palloc_free_page (pd);
+
+  printf ("cpu: %zu CPU%s in use\n", cpu_cnt, cpu_cnt != 1 ? "s" : "");
+}
+
+/* Routes the ISA interrupts through the I/O APIC to the
+   bootstrap processor, on the same vectors that the PICs use.
+   An ISA interrupt without an assignment in the MP
+   configuration table is wired to the pin with its own number,
+   unless some other interrupt is assigned to that pin.  IRQ 2 is
+   the PICs' cascade and is never used. */
+static void
+route_isa_irqs (void)
+{
+  size_t pin_cnt = ioapic_pin_cnt ();
+  bool pin_taken[256];
+  size_t irq;
+
+  memset (pin_taken, 0, sizeof pin_taken);
+  for (irq = 0; irq < 16; irq++)
+    if (isa_irqs[irq].assigned)
+      pin_taken[isa_irqs[irq].pin] = true;
+
+  for (irq = 0; irq < 16; irq++)
+    {
+      struct isa_irq *i = &isa_irqs[irq];
+      if (i->assigned)
+        {
+          if (i->pin < pin_cnt)
+            ioapic_route (i->pin, 0x20 + irq,
+                          (i->flags & MP_IRQ_POLARITY) == MP_IRQ_LOW,
+                          (i->flags & MP_IRQ_TRIGGER) == MP_IRQ_LEVEL,
+                          cpus[0].apic_id);
+        }
+      else if (irq != 2 && irq < pin_cnt && !pin_taken[irq])
+        ioapic_route (irq, 0x20 + irq, false, false, cpus[0].apic_id);
+    }
+}
+
+/* Main function for an application processor, called by the
+   code in ap-start.S with interrupts off, on the stack of the
+   idle thread that cpu_start() prepared for it.  Finishes
+   setting up the processor like the bootstrap processor and
+   brings it online.
+
+   The bootstrap processor holds the interrupt lock much of the
+   time, so printf() here could deadlock against it, and is
+   avoided. */
+static void
+cpu_ap_main (void)
+{
+  struct cpu *c = cpu_current ();
+
+#ifdef USERPROG
+  gdt_init_ap (c->id);
+#else
+  asm volatile ("lgdt %0" : : "m" (boot_gdtr));
+#endif
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+  intr_init_ap ();
+  lapic_init (false);
+  lapic_timer_start ();
+  c->pagedir = init_page_dir;
+  cpu_cnt++;
+  thread_start_ap ();
+}
+
+/* Sends CPU C a reschedule interrupt, which makes it look for a
+   thread to run: it preempts its running thread if a
+   higher-priority thread is ready on it, and an idle CPU wakes
+   up and looks for a thread to steal.  Interrupts must be
+   off. */
+void
+cpu_kick (struct cpu *c)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (c != cpu_current ());
+
+  lapic_send_ipi (c->apic_id, APIC_RESCHED_VEC);
+}
+
+/* Makes sure that no CPU's TLB holds stale entries for page
+   directory PD, after some of its entries were changed in a way
+   that requires flushing the TLB.  The running CPU's TLB is the
+   caller's business.
+
+   Each other CPU that has PD loaded into CR3 is asked to flush
+   its TLB, by setting its tlb_flush and sending it a TLB
+   shootdown IPI, and we wait until all of them have done so.  A
+   CPU may be waiting for the interrupt lock, which we hold, with
+   interrupts off, so CPUs also poll tlb_flush while they wait
+   for it (see cpu_tlb_poll()).  The IPI itself does not need the
+   interrupt lock. */
+void
+cpu_flush_tlb (uint32_t *pd)
+{
+  enum intr_level old_level;
+  struct cpu *cur;
+  size_t i;
+
+  if (cpu_cnt < 2)
+    return;
+
+  /* Holding the interrupt lock keeps each CPU's pagedir from
+     changing, and makes us the only CPU sending shootdowns. */
+  old_level = intr_disable ();
+  cur = cpu_current ();
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != cur && cpus[i].pagedir == pd)
+      {
+        cpus[i].tlb_flush = true;
+        lapic_send_ipi (cpus[i].apic_id, APIC_TLB_VEC);
+      }
+  for (i = 0; i < cpu_cnt; i++)
+    while (cpus[i].tlb_flush)
+      asm volatile ("pause" : : : "memory");
+  intr_set_level (old_level);
+}
+
+/* Flushes the running CPU's TLB if another CPU asked for it in
+   cpu_flush_tlb().  Interrupts must be off. */
+void
+cpu_tlb_poll (void)
+{
+  struct cpu *c = cpu_current ();
+
+  if (c->tlb_flush)
+    {
+      /* Reloading CR3 flushes the TLB.  See [IA32-v3a] 3.12
+         "Translation Lookaside Buffers (TLBs)". */
+      uint32_t cr3;
+      asm volatile ("movl %%cr3, %0; movl %0, %%cr3"
+                    : "=r" (cr3) : : "memory");
+      c->tlb_flush = false;
+    }
+}
+
+/* Local APIC timer interrupt handler, on the application
+   processors. */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_tick ();
+}
+
+/* Reschedule IPI handler.  See cpu_kick(). */
+static void
+resched_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_preempt ();
+}
+
+/* TLB shootdown IPI handler.  See cpu_flush_tlb(). */
+static void
+tlb_interrupt (struct intr_frame *args UNUSED)
+{
+  cpu_tlb_poll ();
+}
+
+/* Converts CYCLES, a count of time-stamp counter cycles, to
+   microseconds.  The TSC frequency is estimated from the cycles
+   and timer ticks that have elapsed since boot. */
+uint64_t
+cpu_tsc_to_us (uint64_t cycles)
+{
+  int64_t ticks = timer_ticks ();
+  uint64_t tsc_hz;
+
+  if (ticks == 0)
+    return 0;
+  tsc_hz = (cpu_rdtsc () - boot_tsc) * TIMER_FREQ / ticks;
+  return tsc_hz != 0 ? cycles * 1000000 / tsc_hz : 0;
+}
+
+/* Searches for the MP floating pointer structure in the places
+   the MP specification allows: the first kilobyte of the
+   extended BIOS data area, the last kilobyte of base memory, and
+   the BIOS ROM between 0xf0000 and 0xfffff.  Returns the
+   structure if found, otherwise a null pointer. */
+static struct mp_fp *
+mp_search (void)
+{
+  uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_fp *fp = NULL;
+
+  if (ebda_seg != 0)
+    fp = mp_search_range ((uintptr_t) ebda_seg << 4, 1024);
+  if (fp == NULL && base_kb != 0)
+    fp = mp_search_range ((uintptr_t) base_kb * 1024 - 1024, 1024);
+  if (fp == NULL)
+    fp = mp_search_range (0xf0000, 0x10000);
+  return fp;
+}
+
+/* Searches SIZE bytes of physical memory starting at PADDR for
+   an MP floating pointer structure, which is always aligned on
+   a 16-byte boundary. */
+static struct mp_fp *
+mp_search_range (uintptr_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_fp) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum_ok (p, sizeof (struct mp_fp)))
+      return (struct mp_fp *) p;
+  return NULL;
+}
+
+/* Returns true if the SIZE bytes at P sum to 0 mod 256, as MP
+   structures must. */
+static bool
+checksum_ok (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
@@ -0,0 +1,101 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <list.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Maximum number of CPUs supported. */
+#define CPU_MAX 8
+
+/* Number of priority levels, and bits per ready_mask word. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+#define READY_MASK_BITS 32
+
+/* Run queue latency histogram buckets.  Bucket N counts waits
+   of 2**N to 2**(N+1) - 1 TSC cycles; the last bucket also
+   counts all longer waits. */
+#define RQ_LATENCY_BUCKETS 40
+
+/* Per-CPU scheduler state.
+
+   Each CPU has its own run queues, one FIFO queue per priority
+   level.  Bit P of ready_mask is set if and only if
+   ready_queues[P] is nonempty, so that the highest-priority
+   ready thread can be found with a single bit scan regardless
+   of how many threads are ready.
+
+   A thread is queued on the CPU it last ran on (its `cpu'
+   member), at first the CPU that created it.  A CPU whose
+   queues run dry steals a thread from the CPU with the most
+   ready threads, and runs its idle thread only if there is
+   nothing to steal.
+
+   Disabling interrupts keeps a CPU's own threads away from its
+   queues, but not other CPUs, which may wake threads that belong
+   to it or steal them, so the queues are also protected by LOCK.
+   The CPU holds its lock across a thread switch and releases it
+   in thread_schedule_tail(). */
+struct cpu
+  {
+    unsigned id;                        /* Index in cpus[]. */
+    uint8_t apic_id;                    /* Local APIC ID. */
+    struct spinlock lock;               /* Protects the members below. */
+    struct list ready_queues[PRI_CNT];  /* Run queues. */
+    uint32_t ready_mask[DIV_ROUND_UP (PRI_CNT, READY_MASK_BITS)];
+    size_t ready_cnt;                   /* Number of threads in run queues. */
+    struct thread *running;             /* Thread running on this CPU. */
+    struct thread *idle_thread;         /* This CPU's idle thread. */
+    unsigned slice_ticks;               /* # of timer ticks since last yield. */
+
+    /* Interrupt state, used only by this CPU.  See interrupt.c. */
+    bool in_external_intr;              /* Processing an external interrupt? */
+    bool yield_on_return;               /* Yield on interrupt return? */
+
+    /* TLB shootdown.  See cpu_flush_tlb(). */
+    uint32_t *pagedir;                  /* Page directory in CR3. */
+    volatile bool tlb_flush;            /* Set to ask for a TLB flush. */
+
+    /* Scheduler statistics, updated only by this CPU. */
+    unsigned long long vol_switches;    /* Switches away from blocked threads. */
+    unsigned long long invol_switches;  /* Switches away from ready threads. */
+    unsigned long long rq_latency[RQ_LATENCY_BUCKETS];
+  };
+
+/* CPUs.  The first cpu_cnt entries are online; cpus[0] is the
+   bootstrap processor. */
+extern struct cpu cpus[CPU_MAX];
+extern size_t cpu_cnt;
+
+/* Number of processors found in the MP configuration table,
+   which may exceed cpu_cnt. */
+extern size_t cpu_present_cnt;
+
+/* Physical addresses of the local APIC and first I/O APIC, or 0
+   if unknown. */
+extern uint32_t lapic_paddr;
+extern uint32_t ioapic_paddr;
+
+void cpu_init (void);
+void cpu_start (void);
+struct cpu *cpu_current (void);
+void cpu_kick (struct cpu *);
+void cpu_flush_tlb (uint32_t *pd);
+void cpu_tlb_poll (void);
+uint64_t cpu_tsc_to_us (uint64_t cycles);
+
+/* Returns the processor's time-stamp counter, which counts CPU
+   clock cycles since reset. */
+static inline uint64_t
+cpu_rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/cpu.h */
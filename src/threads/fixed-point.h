@@ -0,0 +1,97 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, as used by the 4.4BSD
+   scheduler.
+
+   A fixed_t holds a real number X as the integer X * FP_ONE,
+   that is, with 17 bits before the binary point and 14 bits
+   after it (plus a sign bit).  Its range is therefore about
+   -131,072 to 131,071.  Multiplication and division go through
+   64-bit intermediates so that they don't overflow before the
+   result is scaled back down. */
+typedef int32_t fixed_t;
+
+#define FP_FRACTION_BITS 14                     /* Bits after the point. */
+#define FP_ONE (1 << FP_FRACTION_BITS)          /* 1.0 in fixed-point. */
+
+/* Converts integer N to fixed-point. */
+static inline fixed_t
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_trunc (fixed_t x)
+{
+  return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_t x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + Y. */
+static inline fixed_t
+fp_add (fixed_t x, fixed_t y)
+{
+  return x + y;
+}
+
+/* Returns X - Y. */
+static inline fixed_t
+fp_sub (fixed_t x, fixed_t y)
+{
+  return x - y;
+}
+
+/* Returns X + N, for integer N. */
+static inline fixed_t
+fp_add_int (fixed_t x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X - N, for integer N. */
+static inline fixed_t
+fp_sub_int (fixed_t x, int n)
+{
+  return x - n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fp_mul (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * y / FP_ONE;
+}
+
+/* Returns X * N, for integer N. */
+static inline fixed_t
+fp_mul_int (fixed_t x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fp_div (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * FP_ONE / y;
+}
+
+/* Returns X / N, for integer N. */
+static inline fixed_t
+fp_div_int (fixed_t x, int n)
+{
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -1,5 +1,6 @@
 #include "threads/init.h"
 #include <console.h>
+#include <ctype.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <limits.h>
@@ -15,6 +16,7 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -22,6 +24,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -31,6 +34,10 @@
 #else
 #include "tests/threads/tests.h"
 #endif
+#ifdef VM
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
@@ -62,6 +69,9 @@ static void paging_init (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+#ifdef USERPROG
+static size_t parse_count (const char *option, const char *value);
+#endif
 static void run_actions (char **argv);
 static void usage (void);
 
@@ -98,6 +108,7 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  cpu_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -112,13 +123,19 @@ main (void)
   input_init ();
 #ifdef USERPROG
   exception_init ();
+  process_init ();
   syscall_init ();
 #endif
+#ifdef VM
+  page_init ();
+#endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+  cpu_start ();
+  workqueue_init ();
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -126,6 +143,9 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -256,9 +276,21 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
-        user_page_limit = atoi (value);
+        user_page_limit = parse_count (name, value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        {
+          stack_page_limit = parse_count (name, value);
+          if (stack_page_limit > THREAD_STACK_SPACE / PGSIZE)
+            PANIC ("COUNT for option `%s' may be at most %d, the size of "
+                   "a stack slot (use -h for help)",
+                   name, THREAD_STACK_SPACE / PGSIZE);
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -277,6 +309,29 @@ parse_options (char **argv)
   return argv;
 }
 
+#ifdef USERPROG
+/* Returns VALUE, the argument to OPTION, as a count of pages.
+   Panics if VALUE is not a whole number of at least 1. */
+static size_t
+parse_count (const char *option, const char *value)
+{
+  const char *p;
+  int cnt;
+
+  if (value == NULL || *value == '\0')
+    PANIC ("option `%s' needs a COUNT (use -h for help)", option);
+  for (p = value; *p != '\0'; p++)
+    if (!isdigit (*p))
+      PANIC ("bad COUNT `%s' for option `%s' (use -h for help)",
+             value, option);
+  cnt = atoi (value);
+  if (cnt < 1)
+    PANIC ("COUNT for option `%s' must be at least 1 (use -h for help)",
+           option);
+  return cnt;
+}
+#endif
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -379,8 +434,13 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the timer tick while idle.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -sl=COUNT          Limit each user stack to COUNT pages.\n"
+          "                     At most one stack slot, the default.\n"
 #endif
           );
   shutdown_power_off ();
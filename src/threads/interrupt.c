@@ -3,12 +3,19 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/apic.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -38,14 +45,46 @@ static const char *intr_names[INTR_CNT];
 static unsigned int unexpected_cnt[INTR_CNT];
 
 /* External interrupts are those generated by devices outside the
-   CPU, such as the timer.  External interrupts run with
-   interrupts turned off, so they never nest, nor are they ever
-   pre-empted.  Handlers for external interrupts also may not
-   sleep, although they may invoke intr_yield_on_return() to
-   request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   CPU, such as the timer, or sent by other CPUs.  External
+   interrupts run with interrupts turned off, so they never nest,
+   nor are they ever pre-empted.  Handlers for external
+   interrupts also may not sleep, although they may invoke
+   intr_yield_on_return() to request that a new process be
+   scheduled just before the interrupt returns.  Whether a CPU is
+   processing an external interrupt, and whether it should yield
+   on return, are in its struct cpu. */
+
+/* Interrupts registered with intr_register_ipi(), which are
+   handled without the interrupt lock. */
+static bool intr_lockless[INTR_CNT];
+
+/* True once the I/O APIC has taken over from the PICs, so that
+   all interrupts are acknowledged to the local APIC. */
+static bool use_apic;
+
+/* The interrupt lock.
+
+   Pintos protects most of its data by disabling interrupts,
+   which only keeps other threads on the same CPU away.  With
+   more than one CPU, each CPU also holds this lock exactly while
+   its interrupts are off: intr_disable() acquires it and
+   intr_enable() releases it, and intr_handler() does the same
+   for interrupt gates, which turn interrupts off on entry, and
+   for returns to code that had interrupts on.  A thread switch
+   always happens with interrupts off, so the lock passes from
+   one thread to the next on the same CPU.
+
+   Code with interrupts on still runs on every CPU at once, so
+   user programs and kernel code that sleeps on locks and
+   semaphores run in parallel.
+
+   The lock is off, at no cost, until intr_lock_start() switches
+   it on just before the application processors start. */
+static struct spinlock intr_lock;
+static bool intr_lock_enabled;
+
+static void intr_lock_acquire (void);
+static void intr_lock_restore (const struct intr_frame *);
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -90,6 +129,9 @@ intr_enable (void)
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (old_level == INTR_OFF && intr_lock_enabled)
+    spinlock_release (&intr_lock);
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -110,8 +152,67 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (old_level == INTR_ON && intr_lock_enabled)
+    intr_lock_acquire ();
+
   return old_level;
 }
+
+/* Enables interrupts and waits for the next one, for the idle
+   thread.  Interrupts must be off. */
+void
+intr_halt (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (intr_lock_enabled)
+    spinlock_release (&intr_lock);
+
+  /* Re-enable interrupts and wait for the next one.
+
+     The `sti' instruction disables interrupts until the
+     completion of the next instruction, so these two
+     instructions are executed atomically.  This atomicity is
+     important; otherwise, an interrupt could be handled
+     between re-enabling interrupts and waiting for the next
+     one to occur, wasting as much as one clock tick worth of
+     time.
+
+     See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+     7.11.1 "HLT Instruction". */
+  asm volatile ("sti; hlt" : : : "memory");
+}
+
+/* Acquires the interrupt lock, which the running CPU must not
+   hold, with interrupts off.  The CPU holding the lock may be
+   waiting for this one to flush its TLB, so we do that while we
+   wait. */
+static void
+intr_lock_acquire (void)
+{
+  ASSERT (!spinlock_held_by_current_cpu (&intr_lock));
+
+  while (!spinlock_try_acquire (&intr_lock))
+    while (intr_lock.locked)
+      {
+        cpu_tlb_poll ();
+        asm volatile ("pause" : : : "memory");
+      }
+}
+
+/* Switches on the interrupt lock.  Must be called on the
+   bootstrap processor, with interrupts off, before any other
+   processor starts. */
+void
+intr_lock_start (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!intr_lock_enabled);
+
+  spinlock_init (&intr_lock);
+  spinlock_acquire (&intr_lock);
+  intr_lock_enabled = true;
+}
 
 /* Initializes the interrupt system. */
 void
@@ -157,6 +258,33 @@ intr_init (void)
   intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Sets up interrupts on an application processor, which shares
+   the bootstrap processor's IDT, and acquires the interrupt
+   lock, since interrupts are off. */
+void
+intr_init_ap (void)
+{
+  uint64_t idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+  intr_lock_acquire ();
+}
+
+/* Hands device interrupts over from the PICs to the I/O APIC,
+   which the caller has already programmed, by masking every
+   interrupt on the PICs.  Interrupts must be off. */
+void
+intr_use_apic (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  outb (PIC0_DATA, 0xff);
+  outb (PIC1_DATA, 0xff);
+  use_apic = true;
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -176,15 +304,32 @@ register_handler (uint8_t vec_no, int dpl, enum intr_level level,
 
 /* Registers external interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The handler will
-   execute with interrupts disabled. */
+   execute with interrupts disabled.  VEC_NO is a device
+   interrupt, 0x20 through 0x2f, or a local APIC interrupt. */
 void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name) 
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT ((vec_no >= 0x20 && vec_no <= 0x2f) || vec_no >= APIC_VEC_MIN);
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Registers interprocessor interrupt VEC_NO to invoke HANDLER,
+   which is named NAME for debugging purposes.  The handler will
+   execute with interrupts disabled, but without the interrupt
+   lock, so that it can run even while another CPU holds the lock
+   and waits for it.  It may only touch the running CPU's own
+   state, and is not an external interrupt in the sense of
+   intr_context(). */
+void
+intr_register_ipi (uint8_t vec_no, intr_handler_func *handler,
+                   const char *name)
+{
+  ASSERT (vec_no >= APIC_VEC_MIN);
+  register_handler (vec_no, 0, INTR_OFF, handler, name);
+  intr_lockless[vec_no] = true;
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
@@ -202,7 +347,7 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT ((vec_no < 0x20 || vec_no > 0x2f) && vec_no < APIC_VEC_MIN);
   register_handler (vec_no, dpl, level, handler, name);
 }
 
@@ -211,7 +356,10 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  /* External interrupts run with interrupts off, which also keeps
+     the running thread from moving to another CPU while we look
+     at the CPU's state. */
+  return intr_get_level () == INTR_OFF && cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -222,7 +370,7 @@ void
 intr_yield_on_return (void) 
 {
   ASSERT (intr_context ());
-  yield_on_return = true;
+  cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -346,26 +494,46 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  struct cpu *c;
+
+  /* Interprocessor interrupts that do without the interrupt lock
+     are handled and acknowledged right away. */
+  if (intr_lockless[frame->vec_no])
+    {
+      intr_handlers[frame->vec_no] (frame);
+      lapic_eoi ();
+      return;
+    }
+
+  /* An interrupt gate turned interrupts off, so take the
+     interrupt lock, as intr_disable() would. */
+  if (intr_lock_enabled && intr_get_level () == INTR_OFF
+      && !spinlock_held_by_current_cpu (&intr_lock))
+    intr_lock_acquire ();
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
+     and they need to be acknowledged on the PIC or local APIC
+     (see below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = ((frame->vec_no >= 0x20 && frame->vec_no < 0x30)
+              || frame->vec_no >= APIC_VEC_MIN);
+  c = cpu_current ();
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
-      in_external_intr = true;
-      yield_on_return = false;
+      c->in_external_intr = true;
+      c->yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == APIC_SPURIOUS_VEC)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
@@ -380,12 +548,47 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      c->in_external_intr = false;
+      if (frame->vec_no < 0x30 && !use_apic)
+        pic_end_of_interrupt (frame->vec_no); 
+      else if (frame->vec_no != APIC_SPURIOUS_VEC)
+        lapic_eoi ();
 
-      if (yield_on_return) 
+      if (c->yield_on_return) 
         thread_yield (); 
     }
+
+#ifdef USERPROG
+  /* A thread whose process is exiting leaves here instead of
+     returning to user mode. */
+  if (frame->cs == SEL_UCSEG)
+    process_check_exiting ();
+#endif
+
+  intr_lock_restore (frame);
+}
+
+/* Called with interrupts on or off just before returning from an
+   interrupt to the code described by FRAME.  Turns interrupts
+   off, to stay off until the return, and makes the running CPU
+   hold the interrupt lock if and only if interrupts will be off
+   after the return.  A handler may have turned interrupts on or
+   off, and a thread_yield() may have brought us back on another
+   CPU, so the lock's state at entry says nothing. */
+static void
+intr_lock_restore (const struct intr_frame *frame)
+{
+  bool held;
+
+  if (!intr_lock_enabled)
+    return;
+
+  asm volatile ("cli" : : : "memory");
+  held = spinlock_held_by_current_cpu (&intr_lock);
+  if ((frame->eflags & FLAG_IF) && held)
+    spinlock_release (&intr_lock);
+  else if (!(frame->eflags & FLAG_IF) && !held)
+    intr_lock_acquire ();
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
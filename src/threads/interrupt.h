@@ -15,6 +15,7 @@ enum intr_level intr_get_level (void);
 enum intr_level intr_set_level (enum intr_level);
 enum intr_level intr_enable (void);
 enum intr_level intr_disable (void);
+void intr_halt (void);
 
 /* Interrupt stack frame. */
 struct intr_frame
@@ -58,7 +59,11 @@ struct intr_frame
 typedef void intr_handler_func (struct intr_frame *);
 
 void intr_init (void);
+void intr_init_ap (void);
+void intr_use_apic (void);
+void intr_lock_start (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
+void intr_register_ipi (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
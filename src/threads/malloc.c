@@ -7,6 +7,7 @@
 #include <string.h>
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,15 +33,52 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   To keep the descriptor locks off the common path, each thread
+   also caches a few free blocks of each size in a "magazine"
+   (see struct malloc_cache).  malloc() and free() use only the
+   calling thread's magazine, without locking, until it runs
+   empty or full.  Then the whole magazine is exchanged with the
+   descriptor at once: a thread with an empty magazine gets a
+   full one from the descriptor's "depot" of full magazines, or
+   failing that fills one from the free list, and a thread with
+   a full magazine puts it in the depot, or if the depot is full
+   returns its blocks to their arenas.  A thread returns its
+   magazines' blocks to their arenas when it exits.
+
+   Blocks in magazines are in use as far as their arenas are
+   concerned.  So that a workload that allocates and frees the
+   same few blocks does not keep obtaining and giving back the
+   same page, a descriptor also keeps up to SPARE_ARENAS
+   entirely free arenas instead of freeing them at once. */
+
+/* Maximum number of blocks in a magazine, and of magazines in a
+   descriptor's depot. */
+#define MAGAZINE_MAX 16
+#define DEPOT_MAX 2
+
+/* Number of unused arenas a descriptor keeps. */
+#define SPARE_ARENAS 1
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t magazine_size;       /* Number of blocks in a full magazine. */
     struct list free_list;      /* List of free blocks. */
+    struct block *depot;        /* Full magazines. */
+    size_t depot_cnt;           /* Number of magazines in depot. */
+    size_t spare_cnt;           /* Number of arenas with no blocks used. */
     struct lock lock;           /* Lock. */
+    char name[16];              /* Name of lock, for profiling. */
+
+    /* Statistics. */
+    unsigned long long loads;   /* Magazines given to threads. */
+    unsigned long long unloads; /* Full magazines taken from threads. */
+    unsigned long long arena_allocs; /* Arenas obtained from palloc. */
+    unsigned long long arena_frees;  /* Arenas given back to palloc. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -54,18 +92,32 @@ struct arena
     size_t free_cnt;            /* Free blocks; pages in big block. */
   };
 
-/* Free block. */
+/* Free block.  A block on its descriptor's free list uses
+   FREE_ELEM, and a block in a magazine uses the other members
+   instead. */
 struct block 
   {
-    struct list_elem free_elem; /* Free list element. */
+    union
+      {
+        struct list_elem free_elem;     /* Free list element. */
+        struct
+          {
+            struct block *next;         /* Next block in magazine. */
+            struct block *next_magazine; /* Next magazine in depot. */
+          };
+      };
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_CLASS_CNT]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static bool load_magazine (struct desc *, struct malloc_cache *);
+static void unload_magazine (struct desc *, struct malloc_cache *);
+static struct block *get_block (struct desc *);
+static void put_block (struct desc *, struct block *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -76,12 +128,30 @@ malloc_init (void)
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
       struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      ASSERT (desc_cnt <= MALLOC_CLASS_CNT);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->magazine_size = (d->blocks_per_arena < MAGAZINE_MAX
+                          ? d->blocks_per_arena : MAGAZINE_MAX);
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      snprintf (d->name, sizeof d->name, "malloc %zu", block_size);
+      lock_init_named (&d->lock, d->name);
     }
+  ASSERT (desc_cnt == MALLOC_CLASS_CNT);
+}
+
+/* Prints statistics for each descriptor that has been used. */
+void
+malloc_print_stats (void)
+{
+  struct desc *d;
+
+  printf ("Malloc: %10s %10s %10s %10s %10s\n", "block size",
+          "loads", "unloads", "arenas", "freed");
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->loads > 0)
+      printf ("        %10zu %10llu %10llu %10llu %10llu\n", d->block_size,
+              d->loads, d->unloads, d->arena_allocs, d->arena_frees);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -89,9 +159,11 @@ malloc_init (void)
 void *
 malloc (size_t size) 
 {
+  struct malloc_cache *cache;
   struct desc *d;
   struct block *b;
   struct arena *a;
+  size_t i;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -119,37 +191,15 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
-    {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
-    }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  /* Take a block from our magazine, refilling it first if it
+     is empty. */
+  cache = &thread_current ()->malloc_cache;
+  i = d - descs;
+  if (cache->cnt[i] == 0 && !load_magazine (d, cache))
+    return NULL;
+  b = cache->blocks[i];
+  cache->blocks[i] = b->next;
+  cache->cnt[i]--;
   return b;
 }
 
@@ -227,32 +277,21 @@ free (void *p)
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          struct malloc_cache *cache = &thread_current ()->malloc_cache;
+          size_t i = d - descs;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
-            {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
-
-          lock_release (&d->lock);
+          /* Add block to our magazine, emptying it first if it is
+             full. */
+          if (cache->cnt[i] >= d->magazine_size)
+            unload_magazine (d, cache);
+          b->next = cache->blocks[i];
+          cache->blocks[i] = b;
+          cache->cnt[i]++;
         }
       else
         {
@@ -263,6 +302,177 @@ free (void *p)
     }
 }
 
+/* Returns the blocks in CACHE, which must belong to the running
+   thread or to a thread that has exited, to their arenas. */
+void
+malloc_cache_flush (struct malloc_cache *cache)
+{
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    if (cache->cnt[i] > 0)
+      {
+        struct desc *d = &descs[i];
+        struct block *b, *next;
+
+        lock_acquire (&d->lock);
+        for (b = cache->blocks[i]; b != NULL; b = next)
+          {
+            next = b->next;
+            put_block (d, b);
+          }
+        lock_release (&d->lock);
+        cache->blocks[i] = NULL;
+        cache->cnt[i] = 0;
+      }
+}
+
+/* Fills CACHE's empty magazine for descriptor D, from D's depot
+   if possible or otherwise from its free list.  Returns true if
+   successful, false if out of memory. */
+static bool
+load_magazine (struct desc *d, struct malloc_cache *cache)
+{
+  size_t i = d - descs;
+  struct block *b;
+
+  ASSERT (cache->cnt[i] == 0);
+
+  lock_acquire (&d->lock);
+  if (d->depot != NULL)
+    {
+      cache->blocks[i] = d->depot;
+      cache->cnt[i] = d->magazine_size;
+      d->depot = d->depot->next_magazine;
+      d->depot_cnt--;
+    }
+  else
+    {
+      cache->blocks[i] = NULL;
+      while (cache->cnt[i] < d->magazine_size && (b = get_block (d)) != NULL)
+        {
+          b->next = cache->blocks[i];
+          cache->blocks[i] = b;
+          cache->cnt[i]++;
+        }
+    }
+  if (cache->cnt[i] > 0)
+    d->loads++;
+  lock_release (&d->lock);
+
+  return cache->cnt[i] > 0;
+}
+
+/* Empties CACHE's full magazine for descriptor D, into D's depot
+   if there is room or otherwise back into the blocks' arenas. */
+static void
+unload_magazine (struct desc *d, struct malloc_cache *cache)
+{
+  size_t i = d - descs;
+
+  ASSERT (cache->cnt[i] == d->magazine_size);
+
+  lock_acquire (&d->lock);
+  if (d->depot_cnt < DEPOT_MAX)
+    {
+      cache->blocks[i]->next_magazine = d->depot;
+      d->depot = cache->blocks[i];
+      d->depot_cnt++;
+    }
+  else
+    {
+      struct block *b, *next;
+
+      for (b = cache->blocks[i]; b != NULL; b = next)
+        {
+          next = b->next;
+          put_block (d, b);
+        }
+    }
+  d->unloads++;
+  lock_release (&d->lock);
+
+  cache->blocks[i] = NULL;
+  cache->cnt[i] = 0;
+}
+
+/* Takes a block from D's free list, creating a new arena if the
+   list is empty, and returns it, or a null pointer if out of
+   memory.  D's lock must be held. */
+static struct block *
+get_block (struct desc *d)
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL) 
+        return NULL; 
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+      d->spare_cnt++;
+      d->arena_allocs++;
+    }
+
+  /* Get a block from free list. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  if (a->free_cnt-- == d->blocks_per_arena)
+    d->spare_cnt--;
+  return b;
+}
+
+/* Returns block B to D's free list.  If that leaves its arena
+   entirely unused, frees the arena unless D is short of spare
+   arenas.  D's lock must be held. */
+static void
+put_block (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, keep it as a spare or
+     free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      if (d->spare_cnt < SPARE_ARENAS)
+        d->spare_cnt++;
+      else
+        {
+          size_t i;
+
+          for (i = 0; i < d->blocks_per_arena; i++) 
+            {
+              struct block *b = arena_to_block (a, i);
+              list_remove (&b->free_elem);
+            }
+          palloc_free_page (a);
+          d->arena_frees++;
+        }
+    }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -3,8 +3,24 @@
 
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/* Number of block size classes, for blocks of 16 bytes up to
+   1 kB. */
+#define MALLOC_CLASS_CNT 7
+
+/* A thread's cache of free blocks: one "magazine" per size
+   class, a stack of up to a few blocks that the thread can
+   allocate and free without locking.  See malloc.c. */
+struct malloc_cache
+  {
+    struct block *blocks[MALLOC_CLASS_CNT]; /* Top of each magazine. */
+    uint8_t cnt[MALLOC_CLASS_CNT];          /* Blocks in each magazine. */
+  };
 
 void malloc_init (void);
+void malloc_print_stats (void);
+void malloc_cache_flush (struct malloc_cache *);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
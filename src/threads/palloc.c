@@ -2,14 +2,19 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -23,14 +28,95 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free memory is
+   kept as blocks of 2**N pages, for "order" N, each aligned on a
+   multiple of its own size relative to the pool's base, with a
+   free list per order.  An allocation takes a block from the
+   smallest nonempty list that is big enough, splits off halves
+   until it is no bigger than needed, and gives back any pages
+   past the end of a request that is not a power of 2.  Freed
+   pages are merged with their free "buddy" block, the other half
+   of the next larger block, as far as possible.  Both take time
+   proportional to the number of orders, not to the pool size.
+
+   Pages can also be freed by parts: the pages are given back as
+   the largest aligned blocks that fit.
+
+   A pool is protected by a spin lock, with interrupts disabled,
+   because pages are freed from thread_schedule_tail() with
+   interrupts off.
+
+   Each pool also keeps a small stock of pages that have already
+   been zeroed, filled by the idle thread through
+   palloc_prezero_page(), so that single-page PAL_ZERO requests
+   usually need not clear a page while the requester waits.
+   These pages are allocated as far as the buddy system is
+   concerned.  If an allocation fails, they are given back and
+   the allocation is retried.
+
+   The split between the pools is not absolute.  A pool that
+   cannot satisfy a request borrows the pages from the other
+   pool, as long as that leaves the lender with at least its
+   reserve of free pages: a quarter of the kernel pool, which
+   must not be run dry by user processes, and an eighth of the
+   user pool.  Borrowed pages are marked as such in the lender's
+   free_order[] and go back to the lender when they are freed.
+   The user pool does not borrow if its size was limited with
+   -ul, and no pool borrows for a PAL_NOBORROW request, which
+   lets the VM system evict a user page instead.
+
+   With VM, the kernel pool also takes its lent pages back, by
+   having the frame table evict the user pages in them: at once
+   when a kernel allocation would otherwise fail, and in the
+   background whenever the kernel pool drops below its reserve. */
+
+/* Largest block order. */
+#define MAX_ORDER 20
+
+/* free_order[] value for a page that does not begin a free
+   block. */
+#define NOT_FREE 0xff
+
+/* free_order[] value for an allocated page that was lent to the
+   other pool. */
+#define LENT 0xfe
+
+/* Maximum number of pre-zeroed pages per pool. */
+#define ZEROED_MAX 64
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    struct spinlock lock;               /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    size_t free_cnt;                    /* Pages in free lists. */
+    size_t reserve_cnt;                 /* Free pages not to lend. */
+    bool may_borrow;                    /* May borrow from other pool? */
+    uint8_t *free_order;                /* Order of block at each page. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks, by order. */
+    void *zeroed[ZEROED_MAX];           /* Pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pre-zeroed pages. */
+    const char *name;                   /* Name, for statistics. */
+
+    /* Statistics. */
+    size_t used_cnt;                    /* Pages allocated. */
+    size_t used_max;                    /* Most pages ever allocated. */
+    size_t lent_cnt;                    /* Pages lent to the other pool. */
+    unsigned long long loan_cnt;        /* Requests satisfied by lending. */
+    unsigned long long short_cnt;       /* Requests it was too short for. */
+    unsigned long long zero_hits;       /* PAL_ZERO pages pre-zeroed. */
+    unsigned long long zero_misses;     /* PAL_ZERO pages zeroed on demand. */
+    unsigned long long prezeroed;       /* Pages zeroed while idle. */
+  };
+
+/* A free block.  Kept at the start of the block's first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in a free list. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +125,12 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void release_zeroed (struct pool *);
+static bool prezero_page (struct pool *);
+static void *take_pages (struct pool *, enum palloc_flags, size_t page_cnt,
+                         bool lend, bool *zeroed);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -59,43 +151,53 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+  kernel_pool.reserve_cnt = kernel_pool.page_cnt / 4;
+  kernel_pool.may_borrow = true;
+  user_pool.reserve_cnt = user_pool.page_cnt / 8;
+  user_pool.may_borrow = user_page_limit == SIZE_MAX;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the pages are filled with zeros.  If too few pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   then the pages are filled with zeros.  If PAL_NOBORROW is
+   set, the pages are not borrowed from the other pool.  If too
+   few pages are available, returns a null pointer, unless
+   PAL_ASSERT is set in FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  struct pool *lender = flags & PAL_USER ? &kernel_pool : &user_pool;
+  bool zeroed = false;
   void *pages;
-  size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  pages = take_pages (pool, flags, page_cnt, false, &zeroed);
+  if (pages == NULL && pool->may_borrow && !(flags & PAL_NOBORROW))
+    pages = take_pages (lender, flags, page_cnt, true, &zeroed);
+#ifdef VM
+  /* Take back pages that the kernel pool lent to user processes,
+     by evicting the user pages in them.  Once the kernel pool is
+     below its reserve, do so in the background too. */
+  if (pool == &kernel_pool)
+    {
+      while (pages == NULL && frame_reclaim ())
+        pages = take_pages (pool, flags, page_cnt, false, &zeroed);
+      if (palloc_kernel_low ())
+        frame_reclaim_later ();
+    }
+#endif
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
     }
-  else 
-    {
-      if (flags & PAL_ASSERT)
-        PANIC ("palloc_get: out of pages");
-    }
+  else if (flags & PAL_ASSERT)
+    PANIC ("palloc_get: out of pages");
 
   return pages;
 }
@@ -118,7 +220,9 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
+  size_t i;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -137,8 +241,20 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  for (i = 0; i < page_cnt; i++)
+    if (pool->free_order[page_idx + i] == LENT)
+      {
+        pool->free_order[page_idx + i] = NOT_FREE;
+        pool->lent_cnt--;
+      }
+  pool->used_cnt -= page_cnt;
+  free_pages (pool, page_idx, page_cnt);
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,15 +264,76 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page and adds it to the stock of pre-zeroed
+   pages of the pool that has fewer of them, or of the other pool
+   if that one has no free page, for later PAL_ZERO allocations.
+   Returns true if successful, false if neither pool has both
+   room in its stock and a free page.  Meant to be called when
+   there is nothing better to do, with interrupts on. */
+bool
+palloc_prezero_page (void)
+{
+  struct pool *first = (kernel_pool.zeroed_cnt <= user_pool.zeroed_cnt
+                        ? &kernel_pool : &user_pool);
+  struct pool *second = first == &kernel_pool ? &user_pool : &kernel_pool;
+
+  return prezero_page (first) || prezero_page (second);
+}
+
+/* Returns true if PAGE, which must be allocated, is a page that
+   the kernel pool lent to the user pool. */
+bool
+palloc_page_lent (void *page)
+{
+  return (page_from_pool (&kernel_pool, page)
+          && kernel_pool.free_order[pg_no (page) - pg_no (kernel_pool.base)]
+             == LENT);
+}
+
+/* Returns true if the kernel pool is below its reserve of free
+   pages while some of its pages are lent to the user pool.  The
+   pools' locks are not taken, so the answer is only a hint. */
+bool
+palloc_kernel_low (void)
+{
+  return (kernel_pool.lent_cnt > 0
+          && (kernel_pool.free_cnt + kernel_pool.zeroed_cnt
+              < kernel_pool.reserve_cnt));
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  struct pool *pools[] = {&kernel_pool, &user_pool};
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *p = pools[i];
+      printf ("Palloc: %s: %zu pages, %zu used (peak %zu), %zu free, "
+              "%zu lent; %llu requests lent for, %llu found it short\n",
+              p->name, p->page_cnt, p->used_cnt, p->used_max,
+              p->free_cnt + p->zeroed_cnt, p->lent_cnt,
+              p->loan_cnt, p->short_cnt);
+      printf ("Palloc: %s: %llu zeroed pages from stock, "
+              "%llu zeroed on demand, %llu zeroed while idle\n",
+              p->name, p->zero_hits, p->zero_misses, p->prezeroed);
+    }
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and free_order at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size. */
+  size_t bm_size = ROUND_UP (bitmap_buf_size (page_cnt), sizeof (long));
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +341,247 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  spinlock_init (&p->lock);
+  p->name = name;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
   p->base = base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, NOT_FREE, page_cnt);
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
+
+  /* All its pages start out free. */
+  free_pages (p, 0, page_cnt);
+}
+
+/* Returns the free block at page PAGE_IDX in POOL. */
+static struct free_block *
+block_at (const struct pool *pool, size_t page_idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Adds the 2**ORDER pages starting at PAGE_IDX to POOL's free
+   lists as a single block. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order)
+{
+  pool->free_order[page_idx] = order;
+  pool->free_cnt += (size_t) 1 << order;
+  list_push_front (&pool->free_lists[order], &block_at (pool, page_idx)->elem);
+}
+
+/* Allocates a block of 2**ORDER pages from POOL and returns the
+   index of its first page, or BITMAP_ERROR if there is no free
+   block that large. */
+static size_t
+alloc_block (struct pool *pool, int order)
+{
+  struct free_block *b;
+  size_t page_idx;
+  int k;
+
+  /* Find the smallest free block that is big enough. */
+  for (k = order; k <= MAX_ORDER; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      break;
+  if (k > MAX_ORDER)
+    return BITMAP_ERROR;
+  b = list_entry (list_pop_front (&pool->free_lists[k]),
+                  struct free_block, elem);
+  page_idx = ((uint8_t *) b - pool->base) / PGSIZE;
+  pool->free_order[page_idx] = NOT_FREE;
+  pool->free_cnt -= (size_t) 1 << k;
+
+  /* Split it, freeing the upper halves, until it is the right
+     size. */
+  while (k > order)
+    {
+      k--;
+      push_block (pool, page_idx + ((size_t) 1 << k), k);
+    }
+  return page_idx;
+}
+
+/* Frees the block of 2**ORDER pages starting at PAGE_IDX in
+   POOL, merging it with its buddy, and the resulting block with
+   its own buddy, for as long as they are free. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  while (order < MAX_ORDER)
+    {
+      size_t size = (size_t) 1 << order;
+      size_t buddy = page_idx ^ size;
+
+      if (buddy + size > pool->page_cnt || pool->free_order[buddy] != order)
+        break;
+      list_remove (&block_at (pool, buddy)->elem);
+      pool->free_order[buddy] = NOT_FREE;
+      pool->free_cnt -= size;
+      page_idx &= ~size;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if that is not possible. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx;
+  int order = 0;
+
+  while (((size_t) 1 << order) < page_cnt)
+    if (++order > MAX_ORDER)
+      return BITMAP_ERROR;
+
+  page_idx = alloc_block (pool, order);
+  if (page_idx != BITMAP_ERROR)
+    free_pages (pool, page_idx + page_cnt,
+                ((size_t) 1 << order) - page_cnt);
+  return page_idx;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   first, or a null pointer if that is not possible.  If LEND is
+   true, the pages are for the other pool, and are allocated only
+   if POOL keeps its reserve of free pages.  Sets *ZEROED to true
+   if the page returned is already zeroed.  Counts the request in
+   POOL's statistics. */
+static void *
+take_pages (struct pool *pool, enum palloc_flags flags, size_t page_cnt,
+            bool lend, bool *zeroed)
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  if (lend && pool->free_cnt + pool->zeroed_cnt < pool->reserve_cnt + page_cnt)
+    {
+      /* Would go below the low watermark. */
+    }
+  else if ((flags & PAL_ZERO) && page_cnt == 1 && pool->zeroed_cnt > 0)
+    {
+      /* Take a page that is already zeroed. */
+      void *page = pool->zeroed[--pool->zeroed_cnt];
+      page_idx = pg_no (page) - pg_no (pool->base);
+      pool->zero_hits++;
+      *zeroed = true;
+    }
+  else
+    {
+      page_idx = alloc_pages (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+        {
+          release_zeroed (pool);
+          page_idx = alloc_pages (pool, page_cnt);
+        }
+      if (page_idx != BITMAP_ERROR)
+        {
+          ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+          bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+          if (flags & PAL_ZERO)
+            pool->zero_misses += page_cnt;
+        }
+    }
+  if (page_idx != BITMAP_ERROR)
+    {
+      pool->used_cnt += page_cnt;
+      if (pool->used_cnt > pool->used_max)
+        pool->used_max = pool->used_cnt;
+      if (lend)
+        {
+          memset (pool->free_order + page_idx, LENT, page_cnt);
+          pool->lent_cnt += page_cnt;
+          pool->loan_cnt++;
+        }
+    }
+  else if (!lend)
+    pool->short_cnt++;
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+
+  return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Zeroes one free page in POOL and adds it to POOL's stock of
+   pre-zeroed pages.  Returns true if successful, false if the
+   stock is full or POOL has no free page. */
+static bool
+prezero_page (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+  void *page;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  page_idx = (pool->zeroed_cnt < ZEROED_MAX
+              ? alloc_pages (pool, 1) : BITMAP_ERROR);
+  if (page_idx != BITMAP_ERROR)
+    bitmap_mark (pool->used_map, page_idx);
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = pool->base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  if (pool->zeroed_cnt < ZEROED_MAX)
+    {
+      pool->zeroed[pool->zeroed_cnt++] = page;
+      pool->prezeroed++;
+    }
+  else
+    {
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+
+  return true;
+}
+
+/* Gives POOL's pre-zeroed pages back to its free lists.  POOL's
+   lock must be held. */
+static void
+release_zeroed (struct pool *pool)
+{
+  while (pool->zeroed_cnt > 0)
+    {
+      void *page = pool->zeroed[--pool->zeroed_cnt];
+      size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   largest aligned blocks that fit. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
 }
 
 /* Returns true if PAGE was allocated from POOL,
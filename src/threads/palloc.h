@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -8,7 +9,8 @@ enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_NOBORROW = 010          /* Don't borrow from the other pool. */
   };
 
 void palloc_init (size_t user_page_limit);
@@ -16,5 +18,9 @@ void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_prezero_page (void);
+bool palloc_page_lent (void *);
+bool palloc_kernel_low (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
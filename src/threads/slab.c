@@ -0,0 +1,250 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Each slab is one page.  It begins with a struct slab header,
+   followed by a stack of the indexes of the slab's free objects,
+   followed by the objects themselves.
+
+   Space left over at the end of a slab is used for "coloring":
+   successive slabs start their objects at different offsets, a
+   cache line apart, so that the objects at the same index in
+   different slabs do not all compete for the same cache
+   lines. */
+
+/* Object alignment, in bytes. */
+#define SLAB_ALIGN 8
+
+/* Distance between slab colors, in bytes. */
+#define SLAB_COLOR_STEP 64
+
+/* Number of wholly free slabs a cache keeps. */
+#define SLAB_SPARE_CNT 1
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    uint8_t *objs;              /* First object. */
+    uint16_t free_cnt;          /* Number of free objects. */
+    uint16_t free[];            /* Indexes of free objects. */
+  };
+
+/* All caches, for statistics. */
+static struct slab_cache *all_caches;
+
+static size_t header_size (size_t obj_per_slab);
+static struct slab *slab_create (struct slab_cache *);
+static void slab_destroy (struct slab_cache *, struct slab *);
+
+/* Initializes CACHE to allocate objects of SIZE bytes, named
+   NAME.  CTOR and DTOR, if nonnull, construct and destroy
+   objects as their slabs are created and freed.  Does not
+   allocate any memory, so it may be called before the page
+   allocator is initialized. */
+void
+slab_cache_init (struct slab_cache *cache, const char *name, size_t size,
+                 slab_ctor_func *ctor, slab_ctor_func *dtor)
+{
+  size_t n;
+
+  ASSERT (cache != NULL);
+  ASSERT (size > 0);
+
+  cache->name = name;
+  cache->obj_size = ROUND_UP (size, SLAB_ALIGN);
+
+  /* Fit as many objects as we can. */
+  n = (PGSIZE - sizeof (struct slab)) / (cache->obj_size + sizeof (uint16_t));
+  while (n > 0 && header_size (n) + n * cache->obj_size > PGSIZE)
+    n--;
+  ASSERT (n > 0);
+  cache->obj_per_slab = n;
+  cache->color_max = PGSIZE - header_size (n) - n * cache->obj_size;
+  cache->color_next = 0;
+
+  cache->ctor = ctor;
+  cache->dtor = dtor;
+  lock_init_named (&cache->lock, name);
+  list_init (&cache->partial_slabs);
+  list_init (&cache->full_slabs);
+  list_init (&cache->free_slabs);
+  cache->slab_cnt = 0;
+  cache->in_use_cnt = cache->in_use_max = 0;
+  cache->alloc_cnt = 0;
+
+  cache->next = all_caches;
+  all_caches = cache;
+}
+
+/* Allocates and returns an object from CACHE, or a null pointer
+   if memory is not available.  The object is in the state its
+   constructor left it in, or the state it was freed in. */
+void *
+slab_alloc (struct slab_cache *cache)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&cache->lock);
+
+  /* Prefer partly used slabs, to let free slabs go. */
+  if (!list_empty (&cache->partial_slabs))
+    s = list_entry (list_front (&cache->partial_slabs), struct slab, elem);
+  else if (!list_empty (&cache->free_slabs))
+    {
+      s = list_entry (list_pop_front (&cache->free_slabs), struct slab, elem);
+      list_push_front (&cache->partial_slabs, &s->elem);
+    }
+  else
+    {
+      s = slab_create (cache);
+      if (s == NULL)
+        {
+          lock_release (&cache->lock);
+          return NULL;
+        }
+      list_push_front (&cache->partial_slabs, &s->elem);
+    }
+
+  obj = s->objs + s->free[--s->free_cnt] * cache->obj_size;
+  if (s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&cache->full_slabs, &s->elem);
+    }
+
+  cache->alloc_cnt++;
+  if (++cache->in_use_cnt > cache->in_use_max)
+    cache->in_use_max = cache->in_use_cnt;
+  lock_release (&cache->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from CACHE and
+   must be in its constructed state, to CACHE.  Does nothing if
+   OBJ is a null pointer. */
+void
+slab_free (struct slab_cache *cache, void *obj)
+{
+  struct slab *s;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == cache);
+  ASSERT ((uint8_t *) obj >= s->objs);
+  ASSERT (((uint8_t *) obj - s->objs) % cache->obj_size == 0);
+  idx = ((uint8_t *) obj - s->objs) / cache->obj_size;
+
+  lock_acquire (&cache->lock);
+  ASSERT (s->free_cnt < cache->obj_per_slab);
+  s->free[s->free_cnt++] = idx;
+  if (s->free_cnt == 1)
+    {
+      /* It was full, now it's partly used. */
+      list_remove (&s->elem);
+      list_push_front (&cache->partial_slabs, &s->elem);
+    }
+  if (s->free_cnt == cache->obj_per_slab)
+    {
+      /* Now it's entirely free.  Keep it as a spare, or free it. */
+      list_remove (&s->elem);
+      if (list_size (&cache->free_slabs) < SLAB_SPARE_CNT)
+        list_push_front (&cache->free_slabs, &s->elem);
+      else
+        slab_destroy (cache, s);
+    }
+  cache->in_use_cnt--;
+  lock_release (&cache->lock);
+}
+
+/* Prints statistics for each cache. */
+void
+slab_print_stats (void)
+{
+  struct slab_cache *cache;
+
+  printf ("Slab: %-12s %6s %6s %8s %8s %8s %10s\n", "cache", "size",
+          "per", "slabs", "in use", "max", "allocs");
+  for (cache = all_caches; cache != NULL; cache = cache->next)
+    printf ("      %-12s %6zu %6zu %8zu %8zu %8zu %10llu\n", cache->name,
+            cache->obj_size, cache->obj_per_slab, cache->slab_cnt,
+            cache->in_use_cnt, cache->in_use_max, cache->alloc_cnt);
+}
+
+/* Returns the size of the header of a slab with OBJ_PER_SLAB
+   objects. */
+static size_t
+header_size (size_t obj_per_slab)
+{
+  return ROUND_UP (sizeof (struct slab) + obj_per_slab * sizeof (uint16_t),
+                   SLAB_ALIGN);
+}
+
+/* Creates and returns a new slab for CACHE, with all of its
+   objects constructed and free, or a null pointer if memory is
+   not available.  CACHE's lock must be held. */
+static struct slab *
+slab_create (struct slab_cache *cache)
+{
+  struct slab *s;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->objs = (uint8_t *) s + header_size (cache->obj_per_slab)
+            + cache->color_next;
+  cache->color_next += SLAB_COLOR_STEP;
+  if (cache->color_next > cache->color_max)
+    cache->color_next = 0;
+
+  /* Hand out objects in address order. */
+  s->free_cnt = cache->obj_per_slab;
+  for (i = 0; i < cache->obj_per_slab; i++)
+    {
+      s->free[i] = cache->obj_per_slab - 1 - i;
+      if (cache->ctor != NULL)
+        cache->ctor (s->objs + i * cache->obj_size);
+    }
+
+  cache->slab_cnt++;
+  return s;
+}
+
+/* Destroys slab S, all of whose objects must be free, and frees
+   its page.  CACHE's lock must be held. */
+static void
+slab_destroy (struct slab_cache *cache, struct slab *s)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache->lock));
+  ASSERT (s->free_cnt == cache->obj_per_slab);
+
+  if (cache->dtor != NULL)
+    for (i = 0; i < cache->obj_per_slab; i++)
+      cache->dtor (s->objs + i * cache->obj_size);
+  s->magic = 0;
+  palloc_free_page (s);
+  cache->slab_cnt--;
+}
@@ -0,0 +1,55 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object caches.
+
+   A slab cache allocates objects of a single, fixed size, packed
+   into pages called "slabs", so that objects whose size is not
+   a power of 2 do not waste the rest of a malloc() block.
+
+   A cache can have a constructor, which is called on each object
+   when its slab is created, and a destructor, called when its
+   slab is freed.  Objects must be returned to the cache in their
+   constructed state, so that locks, lists, and so on need not be
+   initialized each time an object is allocated.
+
+   Like struct lock, a struct slab_cache is provided by its user
+   and is usually a static variable. */
+
+/* Constructor or destructor for objects in a cache. */
+typedef void slab_ctor_func (void *obj);
+
+/* An object cache. */
+struct slab_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Object size, rounded up for alignment. */
+    size_t obj_per_slab;        /* Objects in each slab. */
+    size_t color_max;           /* Largest color offset, in bytes. */
+    size_t color_next;          /* Color offset for next slab. */
+    slab_ctor_func *ctor;       /* Constructor, or null. */
+    slab_ctor_func *dtor;       /* Destructor, or null. */
+    struct lock lock;           /* Protects the members below. */
+    struct list partial_slabs;  /* Slabs with some objects free. */
+    struct list full_slabs;     /* Slabs with no objects free. */
+    struct list free_slabs;     /* Slabs with all objects free. */
+    struct slab_cache *next;    /* Next cache, for statistics. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t in_use_cnt;          /* Objects allocated. */
+    size_t in_use_max;          /* Most objects ever allocated at once. */
+    unsigned long long alloc_cnt; /* Number of calls to slab_alloc(). */
+  };
+
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+                      slab_ctor_func *ctor, slab_ctor_func *dtor);
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
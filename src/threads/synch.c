@@ -29,9 +29,64 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Maximum length of a chain of lock holders that a priority
+   donation is passed along.  Bounds the time lock_acquire()
+   spends with interrupts off on pathological (or circular)
+   chains. */
+#define DONATION_DEPTH_MAX 8
+
+static void donate_priority (struct lock *);
+
+/* A thread waiting in sema_down_timeout(). */
+struct sema_timeout
+  {
+    struct timer_alarm alarm;   /* Goes off at the deadline. */
+    struct thread *thread;      /* Waiting thread. */
+    struct semaphore *sema;     /* Semaphore waited for. */
+    bool expired;               /* True once the deadline has passed. */
+  };
+
+static timer_alarm_func sema_timeout_expired;
+
+#ifdef LOCK_PROFILE
+/* Lock profiling.
+
+   When the kernel is built with LOCK_PROFILE defined (run "make
+   LOCK_PROFILE=1"), every lock records how often it is acquired,
+   how often and how long its acquirers wait, and how long it is
+   held.  Locks with the same name, which by default means locks
+   initialized by the same line of code, share one set of
+   statistics, so that, for example, all the inode locks are
+   counted together.  lock_print_stats() prints them at
+   shutdown.  Times are measured with the time-stamp counter,
+   which is cheap enough to leave profiling on. */
+struct lock_class
+  {
+    const char *name;           /* Name shared by the locks. */
+    unsigned long long acquire_cnt; /* # of acquisitions. */
+    unsigned long long contend_cnt; /* # of acquisitions that waited. */
+    uint64_t wait_total;        /* Total time spent waiting. */
+    uint64_t wait_max;          /* Longest wait. */
+    uint64_t hold_total;        /* Total time held. */
+    uint64_t hold_max;          /* Longest hold. */
+  };
+
+/* Lock classes.  The last one collects locks whose names don't
+   fit in the table. */
+#define LOCK_CLASS_MAX 128
+static struct lock_class lock_classes[LOCK_CLASS_MAX];
+static size_t lock_class_cnt;
+
+static struct lock_class *lock_class_lookup (const char *name);
+static void lock_profile_acquired (struct lock *, uint64_t start,
+                                   bool contended);
+#endif
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -52,6 +107,8 @@ sema_init (struct semaphore *sema, unsigned value)
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
    to become positive and then atomically decrements it.
+   Waiters are kept in priority order, so the highest-priority
+   waiter is the next one woken.
 
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
@@ -68,8 +125,13 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+
+      list_insert_ordered (&sema->waiters, &cur->elem,
+                           thread_priority_more, NULL);
+      cur->waiting_sema = sema;
       thread_block ();
+      cur->waiting_sema = NULL;
     }
   sema->value--;
   intr_set_level (old_level);
@@ -101,8 +163,112 @@ sema_try_down (struct semaphore *sema)
   return success;
 }
 
+/* Down or "P" operation on a semaphore that gives up after
+   TICKS timer ticks.  Returns true if SEMA was decremented, or
+   false if TICKS passed first.  If TICKS is 0 or less, this is
+   the same as sema_try_down().
+
+   The wait is ended by a timer alarm, so no time is spent
+   polling.  This function may sleep, so it must not be called
+   within an interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks)
+{
+  struct sema_timeout timeout;
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  if (ticks <= 0)
+    return sema_try_down (sema);
+
+  timeout.thread = thread_current ();
+  timeout.sema = sema;
+  timeout.expired = false;
+  timer_alarm_init (&timeout.alarm, sema_timeout_expired, &timeout);
+
+  old_level = intr_disable ();
+  timer_alarm_set (&timeout.alarm, timer_ticks () + ticks);
+  while (sema->value == 0 && !timeout.expired)
+    {
+      struct thread *cur = timeout.thread;
+
+      list_insert_ordered (&sema->waiters, &cur->elem,
+                           thread_priority_more, NULL);
+      cur->waiting_sema = sema;
+      thread_block ();
+      cur->waiting_sema = NULL;
+    }
+  success = sema->value > 0;
+  if (success)
+    sema->value--;
+  timer_alarm_cancel (&timeout.alarm);
+  intr_set_level (old_level);
+
+  return success;
+}
+
+/* Alarm function for sema_down_timeout().  If the thread is
+   still waiting, takes it off the semaphore's wait list and
+   wakes it up. */
+static void
+sema_timeout_expired (struct timer_alarm *alarm)
+{
+  struct sema_timeout *timeout = alarm->aux;
+  struct thread *t = timeout->thread;
+
+  timeout->expired = true;
+  if (t->status == THREAD_BLOCKED && t->waiting_sema == timeout->sema)
+    {
+      list_remove (&t->elem);
+      thread_unblock (t);
+    }
+}
+
+/* Down or "P" operation on a semaphore, except that if
+   thread_interrupt() is called on the running thread, either
+   while it waits or earlier, it stops waiting.  Returns true if
+   SEMA was decremented, false if the thread was interrupted
+   first.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_interruptible (struct semaphore *sema)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (sema->value == 0 && !cur->interrupted)
+    {
+      list_insert_ordered (&sema->waiters, &cur->elem,
+                           thread_priority_more, NULL);
+      cur->waiting_sema = sema;
+      cur->interruptible = true;
+      thread_block ();
+      cur->interruptible = false;
+      cur->waiting_sema = NULL;
+    }
+  success = sema->value > 0;
+  if (success)
+    sema->value--;
+  intr_set_level (old_level);
+
+  return success;
+}
+
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  If that thread has a higher priority than the
+   running thread, the running thread yields (unless interrupts
+   were already off, in which case the caller is responsible).
 
    This function may be called from an interrupt handler. */
 void
@@ -118,6 +284,8 @@ sema_up (struct semaphore *sema)
                                 struct thread, elem));
   sema->value++;
   intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -173,18 +341,27 @@ sema_test_helper (void *sema_)
    onerous, it's a good sign that a semaphore should be used,
    instead of a lock. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name UNUSED)
 {
   ASSERT (lock != NULL);
+  ASSERT (name != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCK_PROFILE
+  lock->class = lock_class_lookup (name);
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While we wait, our priority is donated to the lock's holder,
+   and from there along the chain of locks that holder is
+   waiting for, so that a lower-priority holder cannot keep us
+   waiting behind medium-priority threads.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +369,67 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+#ifdef LOCK_PROFILE
+  uint64_t start = cpu_rdtsc ();
+  bool contended;
+#endif
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCK_PROFILE
+  contended = lock->semaphore.value == 0;
+#endif
+  if (lock->holder != NULL)
+    {
+      cur->waiting_lock = lock;
+      if (!thread_mlfqs)
+        donate_priority (lock);
+    }
+
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+  if (!thread_mlfqs)
+    thread_update_priority (cur);
+#ifdef LOCK_PROFILE
+  lock_profile_acquired (lock, start, contended);
+#endif
+  intr_set_level (old_level);
+}
+
+/* Donates the current thread's priority to the holder of LOCK,
+   then to the holder of the lock that holder is waiting for,
+   and so on, for at most DONATION_DEPTH_MAX links.  Stops early
+   at a holder whose priority is already high enough, because
+   everything further along the chain already has at least that
+   priority too. */
+static void
+donate_priority (struct lock *lock)
+{
+  int priority = thread_current ()->priority;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder;
+
+      if (lock == NULL || lock->holder == NULL)
+        break;
+      holder = lock->holder;
+      if (holder->priority >= priority)
+        break;
+      thread_donate_priority (holder, priority);
+      lock = holder->waiting_lock;
+    }
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +441,29 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->held_locks, &lock->elem);
+#ifdef LOCK_PROFILE
+      lock_profile_acquired (lock, cpu_rdtsc (), false);
+#endif
+    }
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Gives up any priority donated through LOCK, yielding the CPU
+   if the current thread no longer has the highest priority.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +471,29 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCK_PROFILE
+  {
+    uint64_t held = cpu_rdtsc () - lock->acquire_tsc;
+    lock->class->hold_total += held;
+    if (held > lock->class->hold_max)
+      lock->class->hold_max = held;
+  }
+#endif
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  if (!thread_mlfqs)
+    thread_update_priority (cur);
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -245,14 +506,112 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
+
+/* Prints lock contention statistics, most waited-for locks
+   first, if the kernel was built with LOCK_PROFILE. */
+void
+lock_print_stats (void)
+{
+#ifdef LOCK_PROFILE
+  struct lock_class *sorted[LOCK_CLASS_MAX];
+  size_t cnt = 0;
+  size_t i;
+
+  /* Insertion sort by total wait, descending. */
+  for (i = 0; i < lock_class_cnt; i++)
+    {
+      struct lock_class *c = &lock_classes[i];
+      size_t j;
+
+      if (c->acquire_cnt == 0)
+        continue;
+      for (j = cnt; j > 0 && sorted[j - 1]->wait_total < c->wait_total; j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = c;
+      cnt++;
+    }
+
+  printf ("Locks: %zu classes, by total wait (times in us):\n", cnt);
+  printf ("%-28s %10s %10s %10s %10s %10s %10s\n", "name",
+          "acquired", "contended", "wait", "max wait", "held", "max held");
+  for (i = 0; i < cnt; i++)
+    {
+      struct lock_class *c = sorted[i];
+      printf ("%-28s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+              c->name, c->acquire_cnt, c->contend_cnt,
+              cpu_tsc_to_us (c->wait_total), cpu_tsc_to_us (c->wait_max),
+              cpu_tsc_to_us (c->hold_total), cpu_tsc_to_us (c->hold_max));
+    }
+#endif
+}
+
+#ifdef LOCK_PROFILE
+/* Returns the lock class named NAME, creating it if
+   necessary. */
+static struct lock_class *
+lock_class_lookup (const char *name)
+{
+  enum intr_level old_level;
+  struct lock_class *c;
+  size_t i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_class_cnt; i++)
+    if (lock_classes[i].name == name || !strcmp (lock_classes[i].name, name))
+      break;
+  if (i < lock_class_cnt)
+    c = &lock_classes[i];
+  else if (lock_class_cnt < LOCK_CLASS_MAX - 1)
+    {
+      c = &lock_classes[lock_class_cnt++];
+      c->name = name;
+    }
+  else
+    {
+      c = &lock_classes[LOCK_CLASS_MAX - 1];
+      c->name = "(other)";
+      lock_class_cnt = LOCK_CLASS_MAX;
+    }
+  intr_set_level (old_level);
+
+  return c;
+}
+
+/* Records that LOCK was acquired at the current time, after
+   trying to acquire it at time START.  If CONTENDED, the lock
+   was held by another thread at that time.  Interrupts must be
+   off. */
+static void
+lock_profile_acquired (struct lock *lock, uint64_t start, bool contended)
+{
+  struct lock_class *c = lock->class;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->acquire_tsc = cpu_rdtsc ();
+  c->acquire_cnt++;
+  if (contended)
+    {
+      uint64_t wait = lock->acquire_tsc - start;
+      c->contend_cnt++;
+      c->wait_total += wait;
+      if (wait > c->wait_max)
+        c->wait_max = wait;
+    }
+}
+#endif /* LOCK_PROFILE */
 
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    int priority;                       /* Priority of the waiting thread. */
   };
 
+static bool waiter_priority_more (const struct list_elem *,
+                                  const struct list_elem *, void *aux);
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -280,6 +639,9 @@ cond_init (struct condition *cond)
    condition variables.  That is, there is a one-to-many mapping
    from locks to condition variables.
 
+   Waiters are kept in order of their priority at the time they
+   started waiting, highest first.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -295,14 +657,55 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  waiter.priority = thread_get_priority ();
+  list_insert_ordered (&cond->waiters, &waiter.elem,
+                       waiter_priority_more, NULL);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting after TICKS timer
+   ticks.  Either way, LOCK is reacquired before returning.
+   Returns true if COND was signaled, false if the wait timed
+   out. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks)
+{
+  struct semaphore_elem waiter;
+  bool signaled;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  sema_init (&waiter.semaphore, 0);
+  waiter.priority = thread_get_priority ();
+  list_insert_ordered (&cond->waiters, &waiter.elem,
+                       waiter_priority_more, NULL);
+  lock_release (lock);
+  signaled = sema_down_timeout (&waiter.semaphore, ticks);
+  lock_acquire (lock);
+
+  /* A signal may have arrived between the timeout and our
+     reacquiring LOCK.  cond_signal() removes the waiter from
+     COND's list and ups its semaphore while holding LOCK, so now
+     that we hold LOCK either both have happened or neither
+     has. */
+  if (!signaled)
+    {
+      if (sema_try_down (&waiter.semaphore))
+        signaled = true;
+      else
+        list_remove (&waiter.elem);
+    }
+  return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one to wake up
+   from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -336,3 +739,187 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Returns true if the thread waiting in semaphore_elem A has a
+   higher priority than the one waiting in B. */
+static bool
+waiter_priority_more (const struct list_elem *a_, const struct list_elem *b_,
+                      void *aux UNUSED)
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem, elem);
+
+  return a->priority > b->priority;
+}
+
+/* Initializes spin lock S as unlocked. */
+void
+spinlock_init (struct spinlock *s)
+{
+  ASSERT (s != NULL);
+
+  s->locked = 0;
+  s->holder = NULL;
+}
+
+/* Acquires spin lock S, busy-waiting until it becomes available
+   if necessary.  S must not already be held by the current CPU.
+   Interrupts must be off, so that the holder cannot be
+   preempted by a thread that then spins on S forever. */
+void
+spinlock_acquire (struct spinlock *s)
+{
+  ASSERT (s != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!spinlock_held_by_current_cpu (s));
+
+  while (!spinlock_try_acquire (s))
+    {
+      /* Spin on a plain read rather than on the atomic exchange,
+         so that waiting CPUs do not keep stealing the cache
+         line from the holder. */
+      while (s->locked)
+        asm volatile ("pause" : : : "memory");
+    }
+}
+
+/* Tries to acquire spin lock S and returns true if successful or
+   false on failure, without waiting.  Interrupts must be off. */
+bool
+spinlock_try_acquire (struct spinlock *s)
+{
+  unsigned old = 1;
+
+  ASSERT (s != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* XCHG with a memory operand is implicitly locked. */
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (s->locked) : : "memory");
+  if (old != 0)
+    return false;
+  s->holder = cpu_current ();
+  return true;
+}
+
+/* Releases spin lock S, which must be held by the current CPU. */
+void
+spinlock_release (struct spinlock *s)
+{
+  ASSERT (s != NULL);
+  ASSERT (spinlock_held_by_current_cpu (s));
+
+  s->holder = NULL;
+
+  /* x86 does not reorder stores with older loads or stores, so
+     a compiler barrier before the releasing store suffices. */
+  barrier ();
+  s->locked = 0;
+}
+
+/* Returns true if the current CPU holds spin lock S, false
+   otherwise. */
+bool
+spinlock_held_by_current_cpu (const struct spinlock *s)
+{
+  ASSERT (s != NULL);
+
+  return s->locked && s->holder == cpu_current ();
+}
+
+/* Initializes RW, a readers-writer lock.  Any number of readers
+   may hold RW at once, or a single writer.
+
+   Writers are preferred: once a writer is waiting, new readers
+   wait too, so that a steady stream of readers cannot starve
+   writers.  Waiting writers, and waiting readers, are woken in
+   order of priority.
+
+   Like a lock, a readers-writer lock must be released by the
+   thread that acquired it, and may not be acquired recursively.
+   Unlike a lock, it does not donate priority to its holders. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writers_ok);
+  rw->reader_cnt = 0;
+  rw->writer = NULL;
+  rw->waiting_writer_cnt = 0;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
+
+  lock_acquire (&rw->lock);
+  while (rw->writer != NULL || rw->waiting_writer_cnt > 0)
+    cond_wait (&rw->readers_ok, &rw->lock);
+  rw->reader_cnt++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0 && rw->waiting_writer_cnt > 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no thread holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
+
+  lock_acquire (&rw->lock);
+  rw->waiting_writer_cnt++;
+  while (rw->writer != NULL || rw->reader_cnt > 0)
+    cond_wait (&rw->writers_ok, &rw->lock);
+  rw->waiting_writer_cnt--;
+  rw->writer = thread_current ();
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing.  The
+   highest-priority waiting writer goes next, or if there is
+   none, all waiting readers. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->lock);
+  rw->writer = NULL;
+  if (rw->waiting_writer_cnt > 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  else
+    cond_broadcast (&rw->readers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
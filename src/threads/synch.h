@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore
@@ -14,6 +15,8 @@ struct semaphore
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
+bool sema_down_interruptible (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
@@ -22,13 +25,27 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks list. */
+#ifdef LOCK_PROFILE
+    struct lock_class *class;   /* Contention statistics. */
+    uint64_t acquire_tsc;       /* Time-stamp counter when acquired. */
+#endif
   };
 
-void lock_init (struct lock *);
+/* Initializes LOCK, naming it after the place it is initialized
+   for the lock profiler.  Use lock_init_named() to give it a
+   more descriptive name. */
+#define lock_init(LOCK) \
+        lock_init_named (LOCK, __FILE__ ":" LOCK_STR (__LINE__))
+#define LOCK_STR(X) LOCK_STR2 (X)
+#define LOCK_STR2(X) #X
+
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition
@@ -38,9 +55,48 @@ struct condition
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers_ok; /* Signaled when readers may enter. */
+    struct condition writers_ok; /* Signaled when a writer may enter. */
+    int reader_cnt;             /* Number of readers holding lock. */
+    struct thread *writer;      /* Writer holding lock, if any. */
+    int waiting_writer_cnt;     /* Number of writers waiting. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+/* Spin lock.
+
+   Disabling interrupts keeps other threads on the same CPU out
+   of a critical section, but not threads on other CPUs.  Data
+   that other CPUs touch too, such as a CPU's run queues, is
+   protected by a spin lock as well.  A spin lock may only be
+   acquired with interrupts off, and must not be held across
+   anything that sleeps. */
+struct spinlock
+  {
+    volatile unsigned locked;   /* Nonzero while held. */
+    struct cpu *holder;         /* CPU holding lock (for debugging). */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held_by_current_cpu (const struct spinlock *);
+
 /* Optimization barrier.
    The compiler will not reorder operations across an
    optimization barrier.  See "Optimization Barriers" in the
@@ -2,11 +2,16 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
@@ -20,16 +25,14 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, are kept in per-CPU
+   run queues.  See threads/cpu.h. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+static struct spinlock all_lock;        /* Protects all_list. */
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -37,6 +40,9 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Exit status records. */
+static struct slab_cache child_cache;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
   {
@@ -45,6 +51,28 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
+/* One thread's scheduler statistics, as copied for printing by
+   thread_print_sched_stats(). */
+struct thread_sched_stats
+  {
+    tid_t tid;
+    char name[16];
+    uint64_t run_cycles;
+    uint64_t wait_cycles;
+    unsigned vol_switches;
+    unsigned invol_switches;
+  };
+
+/* A copy of the scheduler statistics of up to MAX threads, as of
+   time NOW. */
+struct sched_snapshot
+  {
+    struct thread_sched_stats *stats;
+    size_t cnt;
+    size_t max;
+    uint64_t now;
+  };
+
 /* Statistics. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
@@ -52,31 +80,57 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler. */
+#define MLFQS_PRIORITY_TICKS 4  /* # of timer ticks between priority updates. */
+static fixed_t load_avg;        /* Estimated # of threads ready to run. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
+static bool idle_has_work (struct cpu *);
 static struct thread *running_thread (void);
-static struct thread *next_thread_to_run (void);
+static struct thread *next_thread_to_run (struct cpu *);
+static bool is_idle_thread (const struct thread *);
+static struct cpu *rq_lock (struct thread *);
+static void rq_push (struct cpu *, struct thread *);
+static void rq_remove (struct cpu *, struct thread *);
+static struct thread *rq_pop (struct cpu *);
+static struct thread *rq_steal (struct cpu *);
+static int rq_max_priority (const struct cpu *);
+static void ready_push (struct thread *);
+static void kick_cpu (struct thread *);
+static int ready_max_priority (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static hash_hash_func child_hash;
+static hash_less_func child_less;
+static void release_child (struct child *);
+static void release_child_elem (struct hash_elem *, void *aux);
+static void set_priority (struct thread *, int priority);
+static void count_thread (struct thread *, void *cnt);
+static void copy_thread_sched_stats (struct thread *, void *snapshot);
+static void mlfqs_update_second (void);
+static void mlfqs_update_load_avg (void);
+static void mlfqs_update_recent_cpu (struct thread *, void *coeff);
+static void mlfqs_update_priority (struct thread *, void *aux);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the CPUs' run queues and the tid lock.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -87,17 +141,31 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  size_t i;
+  int j;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  slab_cache_init (&child_cache, "child", sizeof (struct child), NULL, NULL);
+  for (i = 0; i < CPU_MAX; i++)
+    {
+      struct cpu *c = &cpus[i];
+      c->id = i;
+      spinlock_init (&c->lock);
+      for (j = 0; j < PRI_CNT; j++)
+        list_init (&c->ready_queues[j]);
+    }
   list_init (&all_list);
+  spinlock_init (&all_lock);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  initial_thread->sched_stamp = cpu_rdtsc ();
+  cpus[0].running = initial_thread;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -113,7 +181,8 @@ thread_start (void)
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to initialize the CPU's
+     idle_thread. */
   sema_down (&idle_started);
 }
 
@@ -123,9 +192,10 @@ void
 thread_tick (void)
 {
   struct thread *t = thread_current ();
+  struct cpu *c = t->cpu;
 
   /* Update statistics. */
-  if (t == idle_thread)
+  if (t == c->idle_thread)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
@@ -134,17 +204,167 @@ thread_tick (void)
   else
     kernel_ticks++;
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  /* Update the multi-level feedback queue scheduler's
+     statistics.  Between the once-per-second recalculations
+     only the running thread's recent_cpu changes, so only its
+     priority needs to be recomputed every few ticks; walking
+     every thread here would make each tick O(n).  Each CPU
+     ticks, but only the bootstrap processor does the
+     once-per-second work. */
+  if (thread_mlfqs)
+    {
+      int64_t now = timer_ticks ();
+
+      if (t != c->idle_thread)
+        t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+      if (now % TIMER_FREQ == 0 && c->id == 0)
+        mlfqs_update_second ();
+      else if (now % MLFQS_PRIORITY_TICKS == 0)
+        mlfqs_update_priority (t, NULL);
+
+      if (ready_max_priority () > t->priority && t != c->idle_thread)
+        intr_yield_on_return ();
+    }
+
+  /* Enforce preemption.  There is no point in giving up the CPU
+     at the end of a time slice if only lower-priority threads
+     are waiting for it. */
+  if (++c->slice_ticks >= TIME_SLICE
+      && ready_max_priority () >= t->priority)
     intr_yield_on_return ();
 }
 
+/* Accounts for CNT timer ticks that went by in the idle thread
+   without timer interrupts, because the timer was in one-shot
+   mode (see timer_idle_enter()).  Called in place of
+   thread_tick() for those ticks, after the timer's tick count
+   has been advanced past them. */
+void
+thread_idle_ticks (int64_t cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cnt < TIMER_FREQ);
+
+  idle_ticks += cnt;
+  if (thread_mlfqs && timer_ticks () % TIMER_FREQ < cnt)
+    mlfqs_update_second ();
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  thread_print_sched_stats ();
+}
+
+/* Prints scheduler statistics: context switch counts, a
+   histogram of how long threads waited in run queues before
+   running, and the CPU time and run queue wait time of each
+   thread that still exists.
+
+   A switch away from a thread that blocked or exited counts as
+   voluntary.  A switch away from a thread that could have kept
+   running, because its time slice expired, it was preempted, or
+   it called thread_yield(), counts as involuntary. */
+void
+thread_print_sched_stats (void)
+{
+  unsigned long long vol = 0, invol = 0;
+  unsigned long long latency[RQ_LATENCY_BUCKETS];
+  struct sched_snapshot snapshot;
+  enum intr_level old_level;
+  size_t i;
+  int b;
+
+  old_level = intr_disable ();
+  memset (latency, 0, sizeof latency);
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      vol += cpus[i].vol_switches;
+      invol += cpus[i].invol_switches;
+      for (b = 0; b < RQ_LATENCY_BUCKETS; b++)
+        latency[b] += cpus[i].rq_latency[b];
+    }
+  intr_set_level (old_level);
+
+  printf ("Scheduler: %llu voluntary switches, %llu involuntary switches\n",
+          vol, invol);
+  /* Most buckets are well under a microsecond wide, so label them
+     with their bounds in cycles. */
+  printf ("Run queue latency, in TSC cycles:\n");
+  for (b = 0; b < RQ_LATENCY_BUCKETS; b++)
+    if (latency[b] != 0)
+      {
+        unsigned long long lo = b == 0 ? 0 : 1ull << b;
+        if (b == RQ_LATENCY_BUCKETS - 1)
+          printf ("  %14llu or more: %llu\n", lo, latency[b]);
+        else
+          printf ("  %14llu - %llu: %llu\n",
+                  lo, (1ull << (b + 1)) - 1, latency[b]);
+      }
+
+  /* printf() may sleep, which is not allowed while thread_foreach()
+     holds all_lock, so copy the statistics first.  Threads created
+     after we count them are left out. */
+  snapshot.max = 0;
+  old_level = intr_disable ();
+  thread_foreach (count_thread, &snapshot.max);
+  intr_set_level (old_level);
+  snapshot.stats = malloc (snapshot.max * sizeof *snapshot.stats);
+  if (snapshot.stats == NULL)
+    return;
+  snapshot.cnt = 0;
+  old_level = intr_disable ();
+  snapshot.now = cpu_rdtsc ();
+  thread_foreach (copy_thread_sched_stats, &snapshot);
+  intr_set_level (old_level);
+
+  printf ("%5s %-16s %12s %12s %8s %8s\n",
+          "tid", "name", "run (us)", "wait (us)", "vol", "invol");
+  for (i = 0; i < snapshot.cnt; i++)
+    {
+      struct thread_sched_stats *st = &snapshot.stats[i];
+      printf ("%5d %-16s %12llu %12llu %8u %8u\n", st->tid, st->name,
+              cpu_tsc_to_us (st->run_cycles), cpu_tsc_to_us (st->wait_cycles),
+              st->vol_switches, st->invol_switches);
+    }
+  free (snapshot.stats);
+}
+
+/* Adds 1 to *CNT_ for thread T. */
+static void
+count_thread (struct thread *t UNUSED, void *cnt_)
+{
+  size_t *cnt = cnt_;
+  (*cnt)++;
+}
+
+/* Copies T's scheduler statistics into SNAPSHOT_, a struct
+   sched_snapshot, if there is room. */
+static void
+copy_thread_sched_stats (struct thread *t, void *snapshot_)
+{
+  struct sched_snapshot *snapshot = snapshot_;
+  struct thread_sched_stats *st;
+
+  if (snapshot->cnt >= snapshot->max)
+    return;
+  st = &snapshot->stats[snapshot->cnt++];
+  st->tid = t->tid;
+  strlcpy (st->name, t->name, sizeof st->name);
+  st->run_cycles = t->run_cycles;
+  st->wait_cycles = t->wait_cycles;
+  st->vol_switches = t->vol_switches;
+  st->invol_switches = t->invol_switches;
+
+  /* Include the time since T was last switched in or queued. */
+  if (t->status == THREAD_RUNNING)
+    st->run_cycles += snapshot->now - t->sched_stamp;
+  else if (t->status == THREAD_READY)
+    st->wait_cycles += snapshot->now - t->sched_stamp;
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -159,9 +379,9 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, it preempts the running thread before
+   thread_create() returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -170,24 +390,42 @@ thread_create (const char *name, int priority,
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  struct thread *cur = thread_current ();
+  struct child *c;
   tid_t tid;
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
+  /* Set up our children table the first time we create a
+     thread, so that threads that never do don't pay for it. */
+  if (cur->children.buckets == NULL
+      && !hash_init (&cur->children, child_hash, child_less, NULL))
+    return TID_ERROR;
+
+  /* Allocate thread and its exit status record. */
+  c = slab_alloc (&child_cache);
+  if (c == NULL)
+    return TID_ERROR;
   t = palloc_get_page (PAL_ZERO);
   if (t == NULL)
-    return TID_ERROR;
+    {
+      slab_free (&child_cache, c);
+      return TID_ERROR;
+    }
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  t->parent = cur;
 
-  // Pranay drove here
-  /*add to children list*/
-  struct thread *curr = thread_current();
-  list_push_back (&curr->children, &t->c_elem);
-  t->parent = curr;
+  /* Initialize the exit status record, owned by both the new
+     thread and us. */
+  c->tid = tid;
+  c->exit_status = -1;
+  sema_init (&c->exited, 0);
+  c->ref_cnt = 2;
+  t->as_child = c;
+  hash_insert (&cur->children, &c->elem);
 
 
   /* Stack frame for kernel_thread(). */
@@ -232,10 +470,15 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted: immediately if interrupts were
+   on at entry, or on return from the interrupt if called from
+   an interrupt handler.  If the caller had disabled interrupts
+   itself, it may expect that it can atomically unblock a
+   thread and update other data, so in that case preemption is
+   left to the caller, which should call thread_preempt() after
+   turning interrupts back on.  Another CPU that should run T is
+   sent a reschedule interrupt (see kick_cpu()). */
 void
 thread_unblock (struct thread *t)
 {
@@ -245,9 +488,58 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  t->sched_stamp = cpu_rdtsc ();
+  ready_push (t);
   t->status = THREAD_READY;
+  kick_cpu (t);
   intr_set_level (old_level);
+
+  if (old_level == INTR_ON || intr_context ())
+    thread_preempt ();
+}
+
+/* Interrupts thread T.  If T is waiting in
+   sema_down_interruptible(), it wakes up, and from now on
+   sema_down_interruptible() returns at once in T without
+   waiting.  Other waits are not affected.
+
+   This function may be called from an interrupt handler. */
+void
+thread_interrupt (struct thread *t)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  t->interrupted = true;
+  if (t->status == THREAD_BLOCKED && t->interruptible)
+    {
+      list_remove (&t->elem);
+      thread_unblock (t);
+    }
+  intr_set_level (old_level);
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler, the yield is
+   deferred until the handler returns. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *cur = running_thread ();
+  int max_priority = ready_max_priority ();
+  bool outranked = (max_priority >= PRI_MIN
+                    && (is_idle_thread (cur) || max_priority > cur->priority));
+  intr_set_level (old_level);
+
+  if (!outranked)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (old_level == INTR_ON)
+    thread_yield ();
 }
 
 /* Returns the name of the running thread. */
@@ -288,35 +580,36 @@ thread_tid (void)
 void
 thread_exit (void)
 {
-  ASSERT (!intr_context ());
+  struct thread *cur = thread_current ();
 
-  // Sahithi drove here
-  struct list_elem *e;
-  struct thread *curr = thread_current();
-  file_close(curr->executableN);
-  //gets parent thread
-  //unblocks parent thread
-  sema_up(&(curr->c_sema1));
-  //need to find a way to check if parent is still alive
-  //blocks until parent calls wait()
-  sema_down(&(curr->c_sema2));
-  for (e = list_begin (&curr->children); e != list_end (&curr->children); e = list_next (e))
-    {
-      struct thread *temp = list_entry (e, struct thread, c_elem);
-      sema_up(&(temp->c_sema2));
-      list_remove(e);
-      //free all of threads current children
-    }
+  ASSERT (!intr_context ());
 
 #ifdef USERPROG
   process_exit ();
 #endif
 
+  /* Let our parent know that we are done, and drop our
+     references to our own children's records.  Children that are
+     still running free theirs when they exit.  Either way, our
+     page can be freed as soon as we are switched away from. */
+  if (cur->as_child != NULL)
+    {
+      sema_up (&cur->as_child->exited);
+      release_child (cur->as_child);
+    }
+  if (cur->children.buckets != NULL)
+    hash_destroy (&cur->children, release_child_elem);
+
+  /* That was our last call to free(). */
+  malloc_cache_flush (&cur->malloc_cache);
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  spinlock_acquire (&all_lock);
   list_remove (&thread_current()->allelem);
+  spinlock_release (&all_lock);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -333,8 +626,8 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
+  if (!is_idle_thread (cur))
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -349,97 +642,368 @@ thread_foreach (thread_action_func *func, void *aux)
 
   ASSERT (intr_get_level () == INTR_OFF);
 
+  spinlock_acquire (&all_lock);
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
     {
       struct thread *t = list_entry (e, struct thread, allelem);
       func (t, aux);
     }
+  spinlock_release (&all_lock);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  Its
+   effective priority does not drop below that of any thread it
+   has received a donation from.  Yields the CPU if the current
+   thread no longer has the highest priority. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The multi-level feedback queue scheduler computes priorities
+     itself. */
+  if (thread_mlfqs)
+    return;
+
+  thread_current ()->base_priority = new_priority;
+  thread_update_priority (thread_current ());
+  thread_preempt ();
 }
 
-/* Returns the current thread's priority. */
+/* Returns the current thread's effective priority. */
 int
 thread_get_priority (void)
 {
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Donates PRIORITY to T: raises T's effective priority to
+   PRIORITY if it is lower.  Does not preempt the running
+   thread. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  if (priority > t->priority)
+    set_priority (t, priority);
+  intr_set_level (old_level);
+}
+
+/* Recomputes T's effective priority as the higher of its base
+   priority and the priority of the highest-priority thread
+   waiting for any lock that T holds.  Lock waiters are kept in
+   priority order, so that thread is at the front of each lock's
+   waiter list.  Does not preempt the running thread. */
 void
-thread_set_nice (int nice UNUSED)
+thread_update_priority (struct thread *t)
 {
-  /* Not yet implemented. */
+  enum intr_level old_level;
+  struct list_elem *e;
+  int priority;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  priority = t->base_priority;
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      if (!list_empty (waiters))
+        {
+          struct thread *donor = list_entry (list_front (waiters),
+                                             struct thread, elem);
+          if (donor->priority > priority)
+            priority = donor->priority;
+        }
+    }
+  set_priority (t, priority);
+  intr_set_level (old_level);
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is ready, it
+   moves to the matching run queue; if it is waiting on a
+   semaphore, it moves to its new place in the semaphore's
+   priority-ordered waiter list. */
+static void
+set_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (priority == t->priority)
+    return;
+
+  if (t->status == THREAD_READY)
+    {
+      struct cpu *c = rq_lock (t);
+      rq_remove (c, t);
+      t->priority = priority;
+      rq_push (c, t);
+      spinlock_release (&c->lock);
+    }
+  else if (t->status == THREAD_BLOCKED && t->waiting_sema != NULL)
+    {
+      list_remove (&t->elem);
+      t->priority = priority;
+      list_insert_ordered (&t->waiting_sema->waiters, &t->elem,
+                           thread_priority_more, NULL);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Returns true if the thread that contains list element A has a
+   higher priority than the one that contains B.  Used with
+   list_insert_ordered(), this keeps a list of threads in
+   descending priority order, first-come first-served among
+   threads of equal priority. */
+bool
+thread_priority_more (const struct list_elem *a_, const struct list_elem *b_,
+                      void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority > b->priority;
+}
+
+/* Sets the current thread's nice value to NICE.  Under the
+   MLFQS scheduler, also recomputes its priority, yielding if it
+   no longer has the highest priority; otherwise, the nice value
+   does not affect the priority. */
+void
+thread_set_nice (int nice)
+{
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  thread_current ()->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (thread_current (), NULL);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+
+  return recent;
+}
+
+/* Performs the multi-level feedback queue scheduler's
+   once-per-second updates: the load average, then every
+   thread's recent_cpu and priority. */
+static void
+mlfqs_update_second (void)
+{
+  fixed_t twice_load, coeff;
+
+  mlfqs_update_load_avg ();
+  twice_load = fp_mul_int (load_avg, 2);
+  coeff = fp_div (twice_load, fp_add_int (twice_load, 1));
+  thread_foreach (mlfqs_update_recent_cpu, &coeff);
+}
+
+/* Recomputes the system load average, once per second:
+
+     load_avg = (59/60) * load_avg + (1/60) * ready_threads
+
+   where READY_THREADS counts the running thread on each CPU
+   (unless it is the idle thread) and every thread in the run
+   queues. */
+static void
+mlfqs_update_load_avg (void)
+{
+  int ready_threads = 0;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < cpu_cnt; i++)
+    ready_threads += (cpus[i].ready_cnt
+                      + (cpus[i].running != cpus[i].idle_thread));
+
+  load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                     fp_div_int (fp_from_int (ready_threads), 60));
+}
+
+/* Decays T's recent_cpu, once per second, and recomputes its
+   priority to match:
+
+     recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice
+
+   The coefficient is the same for every thread, so the caller
+   computes it once and passes it in COEFF_. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *coeff_)
+{
+  const fixed_t *coeff = coeff_;
+
+  if (is_idle_thread (t))
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (*coeff, t->recent_cpu), t->nice);
+  mlfqs_update_priority (t, NULL);
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values:
+
+     priority = PRI_MAX - (recent_cpu / 4) - (nice * 2)
+
+   clamped to the valid range.  If T is in a run queue, it is
+   moved to the queue for its new priority. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+  int priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (is_idle_thread (t))
+    return;
+
+  priority = PRI_MAX - fp_trunc (fp_div_int (t->recent_cpu, 4)) - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  set_priority (t, priority);
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
+   point it initializes its CPU's idle_thread, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
    special case when the ready list is empty. */
 static void
 idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  thread_current ()->cpu->idle_thread = thread_current ();
   sema_up (idle_started);
 
+  idle_loop ();
+}
+
+/* The idle thread's main loop, on any CPU. */
+static void
+idle_loop (void)
+{
   for (;;)
     {
+      struct cpu *c;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
-      /* Re-enable interrupts and wait for the next one.
+      /* Put the time to use zeroing free pages for later PAL_ZERO
+         allocations, a page at a time, for as long as no thread
+         is ready to run. */
+      c = thread_current ()->cpu;
+      intr_enable ();
+      while (!idle_has_work (c) && palloc_prezero_page ())
+        continue;
+      intr_disable ();
+      if (idle_has_work (c))
+        continue;
 
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
+      /* Stop periodic timer interrupts until we have something
+         to do, if so configured. */
+      timer_idle_enter ();
 
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      /* Wait for the next interrupt. */
+      intr_halt ();
     }
 }
 
+/* Returns true if idle CPU C has a thread to run, either its own
+   or one it can steal. */
+static bool
+idle_has_work (struct cpu *c)
+{
+  size_t i;
+
+  if (c->ready_cnt > 0)
+    return true;
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].ready_cnt > 0)
+      return true;
+  return false;
+}
+
+/* Creates the idle thread for application processor C, which
+   becomes C's running thread, and returns it.  The processor
+   starts on the thread's stack, at the end of its page, and then
+   calls thread_start_ap().  Called by the bootstrap processor. */
+struct thread *
+thread_prepare_ap (struct cpu *c)
+{
+  struct thread *t = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  enum intr_level old_level;
+
+  init_thread (t, "idle", PRI_MIN);
+  t->tid = allocate_tid ();
+
+  old_level = intr_disable ();
+  t->cpu = c;
+  t->status = THREAD_RUNNING;
+  c->idle_thread = c->running = t;
+  intr_set_level (old_level);
+
+  return t;
+}
+
+/* Starts scheduling threads on an application processor, in its
+   idle thread (see thread_prepare_ap()).  Interrupts must be
+   off. */
+void
+thread_start_ap (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  thread_current ()->sched_stamp = cpu_rdtsc ();
+  idle_loop ();
+}
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux)
@@ -487,18 +1051,33 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
   t->magic = THREAD_MAGIC;
+  list_init (&t->held_locks);
+  t->cpu = t != running_thread () ? running_thread ()->cpu : &cpus[0];
+
+  /* A new thread inherits its creator's niceness and recent CPU
+     use.  Under the multi-level feedback queue scheduler these,
+     not PRIORITY, determine its priority. */
+  if (t != running_thread ())
+    {
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+    }
+  if (thread_mlfqs)
+    {
+      old_level = intr_disable ();
+      mlfqs_update_priority (t, NULL);
+      intr_set_level (old_level);
+    }
 
-  // Pranah drove here
-  sema_init(&(t->c_sema1), 0);
-  sema_init(&(t->c_sema2), 0);
-  list_init (&t->children);
   sema_init (&t->le_sema, 0);
   t->parent = NULL;
 
   old_level = intr_disable();
+  spinlock_acquire (&all_lock);
   list_push_back (&all_list, &t->allelem);
+  spinlock_release (&all_lock);
   intr_set_level(old_level);
 }
 
@@ -515,18 +1094,229 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Returns true if T is its CPU's idle thread. */
+static bool
+is_idle_thread (const struct thread *t)
+{
+  return t == t->cpu->idle_thread;
+}
+
+/* Returns the CPU that the running thread is running on.  Before
+   thread_init(), that is the bootstrap processor. */
+struct cpu *
+cpu_current (void)
+{
+  struct thread *t = running_thread ();
+  return is_thread (t) ? t->cpu : &cpus[0];
+}
+
+/* Acquires the run queue lock of the CPU that T belongs to and
+   returns that CPU.  T's CPU can change until the lock is held,
+   if another CPU steals T, so it is rechecked afterward. */
+static struct cpu *
+rq_lock (struct thread *t)
+{
+  for (;;)
+    {
+      struct cpu *c = t->cpu;
+
+      spinlock_acquire (&c->lock);
+      if (c == t->cpu)
+        return c;
+      spinlock_release (&c->lock);
+    }
+}
+
+/* Adds T to the back of C's run queue for T's priority.  C's
+   lock must be held. */
+static void
+rq_push (struct cpu *c, struct thread *t)
+{
+  ASSERT (spinlock_held_by_current_cpu (&c->lock));
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&c->ready_queues[t->priority - PRI_MIN], &t->elem);
+  c->ready_mask[(t->priority - PRI_MIN) / READY_MASK_BITS]
+    |= 1u << ((t->priority - PRI_MIN) % READY_MASK_BITS);
+  c->ready_cnt++;
+}
+
+/* Removes T, which must be in one of C's run queues, from its
+   run queue.  C's lock must be held. */
+static void
+rq_remove (struct cpu *c, struct thread *t)
+{
+  struct list *queue = &c->ready_queues[t->priority - PRI_MIN];
+
+  ASSERT (spinlock_held_by_current_cpu (&c->lock));
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (queue))
+    c->ready_mask[(t->priority - PRI_MIN) / READY_MASK_BITS]
+      &= ~(1u << ((t->priority - PRI_MIN) % READY_MASK_BITS));
+  c->ready_cnt--;
+}
+
+/* Removes and returns the thread at the front of C's
+   highest-priority nonempty run queue, which must exist.  C's
+   lock must be held. */
 static struct thread *
-next_thread_to_run (void)
+rq_pop (struct cpu *c)
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  int priority = rq_max_priority (c);
+  struct thread *t;
+
+  ASSERT (priority >= PRI_MIN);
+
+  t = list_entry (list_front (&c->ready_queues[priority - PRI_MIN]),
+                  struct thread, elem);
+  rq_remove (c, t);
+  return t;
+}
+
+/* Takes the highest-priority ready thread from the other CPU with
+   the most ready threads and moves it to C, whose lock must be
+   held.  Returns the thread, or a null pointer if there is
+   nothing to steal.
+
+   The victim's lock is only tried, not waited for, because two
+   idle CPUs may be trying to steal from each other.  The
+   victim's running thread may briefly be in its run queue (see
+   thread_yield()), and its stack is in use until the victim
+   finishes switching away from it, so it is never taken. */
+static struct thread *
+rq_steal (struct cpu *c)
+{
+  struct cpu *victim = NULL;
+  struct thread *t = NULL;
+  int priority;
+  size_t i;
+
+  ASSERT (spinlock_held_by_current_cpu (&c->lock));
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != c && cpus[i].ready_cnt > 0
+        && (victim == NULL || cpus[i].ready_cnt > victim->ready_cnt))
+      victim = &cpus[i];
+  if (victim == NULL || !spinlock_try_acquire (&victim->lock))
+    return NULL;
+
+  for (priority = rq_max_priority (victim);
+       priority >= PRI_MIN && t == NULL; priority--)
+    {
+      struct list *queue = &victim->ready_queues[priority - PRI_MIN];
+      struct list_elem *e;
+
+      for (e = list_begin (queue); e != list_end (queue); e = list_next (e))
+        {
+          struct thread *candidate = list_entry (e, struct thread, elem);
+          if (candidate != victim->running
+              && candidate != victim->idle_thread)
+            {
+              t = candidate;
+              break;
+            }
+        }
+    }
+  if (t != NULL)
+    {
+      rq_remove (victim, t);
+      t->cpu = c;
+    }
+
+  spinlock_release (&victim->lock);
+  return t;
+}
+
+/* Returns the priority of the highest-priority thread in C's run
+   queues, or PRI_MIN - 1 if they are empty.  Without C's lock,
+   the result is only a hint. */
+static int
+rq_max_priority (const struct cpu *c)
+{
+  int i;
+
+  for (i = sizeof c->ready_mask / sizeof *c->ready_mask - 1; i >= 0; i--)
+    if (c->ready_mask[i] != 0)
+      return (PRI_MIN + i * READY_MASK_BITS
+              + (READY_MASK_BITS - 1 - __builtin_clz (c->ready_mask[i])));
+  return PRI_MIN - 1;
+}
+
+/* Adds T to the back of the run queue for its priority on the
+   CPU it last ran on. */
+static void
+ready_push (struct thread *t)
+{
+  struct cpu *c;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  c = rq_lock (t);
+  rq_push (c, t);
+  spinlock_release (&c->lock);
+}
+
+/* Called with interrupts off just after T was made ready to
+   run, to get another CPU to run it if the CPU T is queued on
+   will not soon get to it by itself: T's CPU if T outranks the
+   thread running there or that CPU is idle, otherwise some idle
+   CPU, which will steal T or another ready thread.  If the
+   running CPU should run T, thread_preempt() takes care of it,
+   and if it is idle, it looks for threads to steal as soon as
+   it returns to its idle loop. */
+static void
+kick_cpu (struct thread *t)
+{
+  struct cpu *cur = cpu_current ();
+  struct cpu *c = t->cpu;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cpu_cnt < 2)
+    return;
+
+  if (c != cur && (c->running == c->idle_thread
+                   || t->priority > c->running->priority))
+    cpu_kick (c);
+  else if (cur->running != cur->idle_thread)
+    for (i = 0; i < cpu_cnt; i++)
+      if (&cpus[i] != cur && &cpus[i] != c
+          && cpus[i].running == cpus[i].idle_thread)
+        {
+          cpu_kick (&cpus[i]);
+          break;
+        }
+}
+
+/* Returns the priority of the highest-priority thread ready to
+   run on the current CPU, or PRI_MIN - 1 if no thread is
+   ready. */
+static int
+ready_max_priority (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return rq_max_priority (cpu_current ());
+}
+
+/* Chooses and returns the next thread to be scheduled on CPU C,
+   whose lock must be held.  Should return a thread from C's run
+   queue, unless the run queue is empty.  (If the running thread
+   can continue running, then it will be in the run queue.)  If
+   the run queue is empty, steals a thread from another CPU, and
+   if there is none to steal either, returns C's idle thread. */
+static struct thread *
+next_thread_to_run (struct cpu *c)
+{
+  struct thread *t;
+
+  if (c->ready_cnt > 0)
+    return rq_pop (c);
+  t = rq_steal (c);
+  return t != NULL ? t : c->idle_thread;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -549,14 +1339,39 @@ void
 thread_schedule_tail (struct thread *prev)
 {
   struct thread *cur = running_thread ();
+  struct cpu *c = prev != NULL ? prev->cpu : cur->cpu;
 
   ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Mark us as running. */
+  /* Mark us as running on this CPU, and let other CPUs at its
+     run queues again now that PREV's stack is no longer in
+     use. */
   cur->status = THREAD_RUNNING;
+  cur->cpu = c;
+  c->running = cur;
+  spinlock_release (&c->lock);
+
+  /* Account for the time we spent waiting to run.  The idle
+     thread is not queued while it waits, so it is left out. */
+  if (prev != NULL)
+    {
+      uint64_t now = cpu_rdtsc ();
+      if (cur != c->idle_thread)
+        {
+          /* The stamp may be from another CPU's TSC, which need
+             not be in step with ours. */
+          uint64_t wait = now > cur->sched_stamp ? now - cur->sched_stamp : 0;
+          int bucket = wait != 0 ? 63 - __builtin_clzll (wait) : 0;
+          if (bucket >= RQ_LATENCY_BUCKETS)
+            bucket = RQ_LATENCY_BUCKETS - 1;
+          cur->wait_cycles += wait;
+          c->rq_latency[bucket]++;
+        }
+      cur->sched_stamp = now;
+    }
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  c->slice_ticks = 0;
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -586,18 +1401,116 @@ static void
 schedule (void)
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct cpu *c = cur->cpu;
+  struct thread *next;
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+
+  /* If the idle thread is handing the CPU to a real thread, go
+     back to periodic timer interrupts. */
+  if (cur == c->idle_thread && c->ready_cnt > 0)
+    timer_idle_exit ();
+
+  /* The lock is released by thread_schedule_tail(), after the
+     switch. */
+  spinlock_acquire (&c->lock);
+  next = next_thread_to_run (c);
   ASSERT (is_thread (next));
 
+  /* Charge the outgoing thread for its time on the CPU.  If it is
+     ready to run, it starts waiting in a run queue now. */
+  if (cur != next)
+    {
+      uint64_t now = cpu_rdtsc ();
+      cur->run_cycles += now - cur->sched_stamp;
+      cur->sched_stamp = now;
+      if (cur->status == THREAD_READY)
+        {
+          cur->invol_switches++;
+          c->invol_switches++;
+        }
+      else
+        {
+          cur->vol_switches++;
+          c->vol_switches++;
+        }
+    }
+
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
 }
 
+/* Returns the exit status record of the running thread's child
+   with the given TID, or a null pointer if there is no such
+   child or it has already been forgotten. */
+struct child *
+thread_find_child (tid_t tid)
+{
+  struct thread *cur = thread_current ();
+  struct child key;
+  struct hash_elem *e;
+
+  if (cur->children.buckets == NULL)
+    return NULL;
+  key.tid = tid;
+  e = hash_find (&cur->children, &key.elem);
+  return e != NULL ? hash_entry (e, struct child, elem) : NULL;
+}
+
+/* Removes C, the exit status record of one of the running
+   thread's children, from its children table and drops the
+   running thread's reference to it.  C must not be used
+   afterward. */
+void
+thread_forget_child (struct child *c)
+{
+  hash_delete (&thread_current ()->children, &c->elem);
+  release_child (c);
+}
+
+/* Drops a reference to C, freeing it if it was the last. */
+static void
+release_child (struct child *c)
+{
+  enum intr_level old_level;
+  bool last;
+
+  old_level = intr_disable ();
+  last = --c->ref_cnt == 0;
+  intr_set_level (old_level);
+
+  if (last)
+    slab_free (&child_cache, c);
+}
+
+/* Drops a reference to the exit status record that contains E.
+   For use with hash_destroy(). */
+static void
+release_child_elem (struct hash_elem *e, void *aux UNUSED)
+{
+  release_child (hash_entry (e, struct child, elem));
+}
+
+/* Returns a hash value for the child record that contains E. */
+static unsigned
+child_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct child, elem)->tid);
+}
+
+/* Returns true if the child record that contains A has a lower
+   tid than the one that contains B. */
+static bool
+child_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct child, elem)->tid
+          < hash_entry (b, struct child, elem)->tid);
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void)
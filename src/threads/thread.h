@@ -2,8 +2,12 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
+#include "threads/malloc.h"
 #include "synch.h"
 
 /* States in a thread's life cycle. */
@@ -25,6 +29,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice to other threads. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -90,40 +99,72 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
+    int base_priority;                  /* Priority before donations. */
+    int nice;                           /* Niceness, for -mlfqs. */
+    fixed_t recent_cpu;                 /* Recent CPU use, for -mlfqs. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct cpu *cpu;                    /* CPU last run on. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct semaphore *waiting_sema;     /* Semaphore being waited on, if any. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+    struct list held_locks;             /* Locks held, for donation. */
+    bool interruptible;                 /* In sema_down_interruptible()? */
+    bool interrupted;                   /* thread_interrupt() called? */
+
+    /* Scheduler statistics, owned by thread.c.  Times are in TSC
+       cycles. */
+    uint64_t sched_stamp;               /* When last switched, or queued. */
+    uint64_t run_cycles;                /* Time spent running. */
+    uint64_t wait_cycles;               /* Time spent in a run queue. */
+    unsigned vol_switches;              /* Switches away while blocking. */
+    unsigned invol_switches;            /* Switches away while runnable. */
+
+    /* Owned by devices/timer.c. */
+    struct timer_alarm sleep_alarm;     /* Wakes us from timer_sleep(). */
+
+    /* Owned by threads/malloc.c. */
+    struct malloc_cache malloc_cache;   /* Free blocks for malloc(). */
+
+    /* Owned by thread.c. */
+    struct hash children;               /* Children's `struct child's. */
+    struct child *as_child;             /* Our record in parent's children. */
 
-    //stores parent thread
-    //list and list elem for children
-    struct list_elem c_elem;
-    struct list children;
-    struct semaphore c_sema1;
-    struct semaphore c_sema2;
     //synchronizes load and exec
     bool le_pass;
     struct semaphore le_sema;
     struct thread *parent;
-    //stores exit status
-    int exit;
-    //stores executable
-    struct file *executableN;
-
-    //for write
-    struct file *fileDir[128];
-
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
-    uint32_t *pagedir;                  /* Page directory. */
+    struct process *process;            /* Process we belong to. */
+    int stack_slot;                     /* User stack slot, 0 if first thread. */
+    uint32_t *pagedir;                  /* Page directory, process->pagedir. */
+    struct file **fileDir;              /* Open files, process->files. */
+    void *user_esp;                     /* User %esp at last system call. */
 #endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
 
+/* Exit status record for a thread, kept in its parent's
+   `children' table.  It is allocated separately from the thread
+   so that an exited thread's page can be freed at once while
+   the parent can still wait for it and collect its status.  The
+   record is freed when both the thread and its parent are done
+   with it. */
+struct child
+  {
+    tid_t tid;                          /* Thread identifier. */
+    int exit_status;                    /* Exit status, -1 if killed. */
+    struct semaphore exited;            /* Upped when the thread exits. */
+    int ref_cnt;                        /* Number of owners, 0 to 2. */
+    struct hash_elem elem;              /* Element in parent's children. */
+  };
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
@@ -131,15 +172,22 @@ extern bool thread_mlfqs;
 
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_prepare_ap (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
+void thread_idle_ticks (int64_t cnt);
 void thread_print_stats (void);
+void thread_print_sched_stats (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
+struct child *thread_find_child (tid_t);
+void thread_forget_child (struct child *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_interrupt (struct thread *);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -147,6 +195,7 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -154,6 +203,10 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
+bool thread_priority_more (const struct list_elem *, const struct list_elem *,
+                           void *aux);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -0,0 +1,200 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of worker threads. */
+#define WORKER_CNT 2
+
+/* Queued work, one FIFO queue per priority class.  Work can be
+   queued from interrupt handlers, so the queues are protected by
+   disabling interrupts. */
+static struct list queues[WORK_PRI_CNT];
+
+/* Upped once for each work item queued.  Work can also be
+   canceled after it was counted, so a worker that gets past
+   this semaphore may still find the queues empty. */
+static struct semaphore work_avail;
+
+/* Statistics. */
+static long long run_cnt[WORK_PRI_CNT]; /* # of items started, by class. */
+
+static thread_func worker;
+static timer_alarm_func delayed_work_due;
+static void enqueue (struct work *);
+
+/* Initializes the work queues and starts the worker threads.
+   Must be called after thread_start(), and before any work is
+   queued. */
+void
+workqueue_init (void)
+{
+  int i;
+
+  for (i = 0; i < WORK_PRI_CNT; i++)
+    list_init (&queues[i]);
+  sema_init (&work_avail, 0);
+
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "worker%d", i);
+      if (thread_create (name, PRI_DEFAULT, worker, NULL) == TID_ERROR)
+        PANIC ("can't create work queue worker thread");
+    }
+}
+
+/* Prints work queue statistics. */
+void
+workqueue_print_stats (void)
+{
+  printf ("Workqueue: %lld high, %lld normal, %lld low priority items\n",
+          run_cnt[WORK_HIGH], run_cnt[WORK_NORMAL], run_cnt[WORK_LOW]);
+}
+
+/* Initializes W as a work item that calls FUNC in a worker
+   thread, in priority class PRIORITY.  FUNC may find AUX in W's
+   `aux' member.  FUNC may sleep, may queue W again, and may free
+   W. */
+void
+work_init (struct work *w, work_func *func, void *aux,
+           enum work_priority priority)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+  ASSERT (priority >= 0 && priority < WORK_PRI_CNT);
+
+  w->func = func;
+  w->aux = aux;
+  w->priority = priority;
+  w->pending = false;
+  timer_alarm_init (&w->alarm, delayed_work_due, w);
+}
+
+/* Queues W to be run by a worker thread as soon as possible.
+   Returns true if successful, or false if W was already pending,
+   in which case it will still run only once.  May be called
+   from an interrupt handler. */
+bool
+work_queue (struct work *w)
+{
+  enum intr_level old_level;
+
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  if (w->pending)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  w->pending = true;
+  list_push_back (&queues[w->priority], &w->elem);
+  intr_set_level (old_level);
+
+  sema_up (&work_avail);
+  return true;
+}
+
+/* Queues W to be run by a worker thread once TICKS timer ticks
+   have passed.  Returns true if successful, or false if W was
+   already pending.  May be called from an interrupt handler. */
+bool
+work_queue_delayed (struct work *w, int64_t ticks)
+{
+  enum intr_level old_level;
+
+  ASSERT (w != NULL);
+
+  if (ticks <= 0)
+    return work_queue (w);
+
+  old_level = intr_disable ();
+  if (w->pending)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  w->pending = true;
+  timer_alarm_set (&w->alarm, timer_ticks () + ticks);
+  intr_set_level (old_level);
+
+  return true;
+}
+
+/* Cancels W if it is pending.  Returns true if it was pending,
+   false otherwise.  If W's function is already running, it is
+   not waited for. */
+bool
+work_cancel (struct work *w)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  was_pending = w->pending;
+  if (was_pending)
+    {
+      if (!timer_alarm_cancel (&w->alarm))
+        list_remove (&w->elem);
+      w->pending = false;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Alarm function for work_queue_delayed().  Runs in the timer
+   interrupt handler. */
+static void
+delayed_work_due (struct timer_alarm *alarm)
+{
+  enqueue (alarm->aux);
+}
+
+/* Adds W, which must be pending, to its queue.  Interrupts must
+   be off. */
+static void
+enqueue (struct work *w)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (w->pending);
+
+  list_push_back (&queues[w->priority], &w->elem);
+  sema_up (&work_avail);
+}
+
+/* Worker thread.  Repeatedly takes the oldest item from the
+   most urgent nonempty queue and runs it. */
+static void
+worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct work *w = NULL;
+      enum intr_level old_level;
+      int i;
+
+      sema_down (&work_avail);
+
+      old_level = intr_disable ();
+      for (i = 0; i < WORK_PRI_CNT; i++)
+        if (!list_empty (&queues[i]))
+          {
+            w = list_entry (list_pop_front (&queues[i]), struct work, elem);
+            w->pending = false;
+            run_cnt[i]++;
+            break;
+          }
+      intr_set_level (old_level);
+
+      /* W may be freed or requeued by its function, so don't
+         touch it afterward. */
+      if (w != NULL)
+        w->func (w);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Deferred work.
+
+   A work item is a function call to be made later by one of a
+   small pool of kernel worker threads, so that code running in
+   an interrupt handler, or on a latency-sensitive path such as
+   a system call, can hand off work that may sleep or take a
+   while.  Work can also be delayed by a number of timer ticks.
+
+   Each work item has a priority class.  Workers always take the
+   oldest item of the most urgent class that has any.
+
+   Like the list and hash table elements, a struct work is
+   embedded in the structure it operates on, and no memory is
+   allocated by the work queue. */
+
+/* Work priority classes, most urgent first. */
+enum work_priority
+  {
+    WORK_HIGH,                  /* E.g. completing I/O. */
+    WORK_NORMAL,                /* Most work. */
+    WORK_LOW,                   /* Background: writeback, zeroing... */
+    WORK_PRI_CNT                /* Number of classes. */
+  };
+
+struct work;
+typedef void work_func (struct work *);
+
+/* A work item. */
+struct work
+  {
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    enum work_priority priority; /* Priority class. */
+    bool pending;               /* Queued or delayed, not yet started. */
+    struct list_elem elem;      /* Element in a work queue. */
+    struct timer_alarm alarm;   /* Queues delayed work. */
+  };
+
+void workqueue_init (void);
+void workqueue_print_stats (void);
+
+void work_init (struct work *, work_func *, void *aux, enum work_priority);
+bool work_queue (struct work *);
+bool work_queue_delayed (struct work *, int64_t ticks);
+bool work_cancel (struct work *);
+
+#endif /* threads/workqueue.h */
@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -147,6 +151,25 @@ page_fault (struct intr_frame *f)
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
+
+#ifdef VM
+  /* Bring in a page that has not been touched yet, or grow the
+     stack.  The kernel can fault on user pages too, when it
+     accesses a buffer passed to a system call, in which case the
+     user's stack pointer is the one saved on entry to the
+     call. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && (page_load (fault_addr)
+          || page_grow_stack (fault_addr,
+                              user ? f->esp : thread_current ()->user_esp)))
+    return;
+
+  /* A write to a page shared copy-on-write with a forked process
+     gets a copy of the page. */
+  if (!not_present && write && user && page_unshare (fault_addr))
+    return;
+#endif
+
   //Joseph Drove here
   //Check for reads, writes, and jumps
   if(!write || (!not_present && user) || not_present)
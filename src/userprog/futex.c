@@ -0,0 +1,161 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* Fast user-space mutexes.
+
+   A futex is just an int in user memory.  User code manipulates
+   it with atomic instructions and enters the kernel only when it
+   has to wait for, or wake up, another thread, so that
+   uncontended locking costs no system calls at all.
+
+   Waiting threads are kept in a hashed wait table keyed by the
+   page directory and the user virtual address of the futex, so
+   futexes in different address spaces never collide.  Each
+   bucket has its own lock, which futex_wait() holds while it
+   compares the futex with the expected value and queues itself.
+   That closes the window in which a wakeup could otherwise be
+   lost between the comparison and going to sleep. */
+
+/* Number of hash buckets.  Must be a power of 2. */
+#define FUTEX_BUCKET_CNT 64
+
+/* A wait table bucket. */
+struct futex_bucket
+  {
+    struct lock lock;           /* Protects WAITERS. */
+    struct list waiters;        /* List of struct futex_waiter. */
+  };
+
+/* A thread waiting in futex_wait(). */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in bucket's WAITERS. */
+    uint32_t *pagedir;          /* Address space of futex. */
+    int *uaddr;                 /* User virtual address of futex. */
+    struct semaphore sema;      /* Upped to wake the waiter. */
+  };
+
+static struct futex_bucket buckets[FUTEX_BUCKET_CNT];
+
+static struct futex_bucket *bucket_for (uint32_t *pagedir, int *uaddr);
+
+/* Initializes the futex wait table. */
+void
+futex_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKET_CNT; i++)
+    {
+      lock_init_named (&buckets[i].lock, "futex bucket");
+      list_init (&buckets[i].waiters);
+    }
+}
+
+/* If the int at UADDR, in the running process's address space,
+   still equals VAL, sleeps until another thread calls
+   futex_wake() on UADDR and returns 0.  Otherwise, returns -1
+   at once.  Also returns -1 if UADDR is not aligned on an int
+   boundary, and, without waiting any longer, if the process
+   starts exiting.  UADDR must have been validated by the caller. */
+int
+futex_wait (int *uaddr, int val)
+{
+  struct thread *cur = thread_current ();
+  struct futex_bucket *b;
+  struct futex_waiter w;
+
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return -1;
+
+#ifdef VM
+  /* Reading the futex must not fault, and perhaps wait for the
+     disk, while we hold the bucket lock. */
+  page_pin (uaddr, sizeof *uaddr, false);
+#endif
+
+  b = bucket_for (cur->pagedir, uaddr);
+  lock_acquire (&b->lock);
+  if (*uaddr != val)
+    {
+      lock_release (&b->lock);
+#ifdef VM
+      page_unpin (uaddr, sizeof *uaddr);
+#endif
+      return -1;
+    }
+  w.pagedir = cur->pagedir;
+  w.uaddr = uaddr;
+  sema_init (&w.sema, 0);
+  list_push_back (&b->waiters, &w.elem);
+  lock_release (&b->lock);
+#ifdef VM
+  page_unpin (uaddr, sizeof *uaddr);
+#endif
+
+  /* If we were woken before getting here, the semaphore is
+     already up.  If our process is exiting instead, take W back
+     out of the bucket, unless futex_wake() just did. */
+  if (!sema_down_interruptible (&w.sema))
+    {
+      lock_acquire (&b->lock);
+      if (!sema_try_down (&w.sema))
+        list_remove (&w.elem);
+      lock_release (&b->lock);
+      return -1;
+    }
+  return 0;
+}
+
+/* Wakes up to CNT threads waiting in futex_wait() on UADDR in
+   the running process's address space, longest waiting first.
+   Returns the number of threads woken, or -1 if UADDR is not
+   aligned on an int boundary. */
+int
+futex_wake (int *uaddr, int cnt)
+{
+  struct thread *cur = thread_current ();
+  struct futex_bucket *b;
+  struct list_elem *e;
+  int woken = 0;
+
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return -1;
+
+  b = bucket_for (cur->pagedir, uaddr);
+  lock_acquire (&b->lock);
+  for (e = list_begin (&b->waiters);
+       e != list_end (&b->waiters) && woken < cnt; )
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+      e = list_next (e);
+      if (w->pagedir == cur->pagedir && w->uaddr == uaddr)
+        {
+          /* W lives on the waiter's stack, so it must not be
+             touched after its semaphore is upped. */
+          list_remove (&w->elem);
+          sema_up (&w->sema);
+          woken++;
+        }
+    }
+  lock_release (&b->lock);
+
+  return woken;
+}
+
+/* Returns the wait table bucket for the futex at UADDR in the
+   address space of PAGEDIR. */
+static struct futex_bucket *
+bucket_for (uint32_t *pagedir, int *uaddr)
+{
+  unsigned h = hash_int ((uintptr_t) uaddr ^ (uintptr_t) pagedir);
+  return &buckets[h & (FUTEX_BUCKET_CNT - 1)];
+}
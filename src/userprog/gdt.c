@@ -29,13 +29,15 @@ static uint64_t make_code_desc (int dpl);
 static uint64_t make_data_desc (int dpl);
 static uint64_t make_tss_desc (void *laddr);
 static uint64_t make_gdtr_operand (uint16_t limit, void *base);
+static void gdt_load (unsigned cpu);
 
 /* Sets up a proper GDT.  The bootstrap loader's GDT didn't
-   include user-mode selectors or a TSS, but we need both now. */
+   include user-mode selectors or a TSS, but we need both now,
+   with a TSS for each CPU. */
 void
 gdt_init (void)
 {
-  uint64_t gdtr_operand;
+  unsigned cpu;
 
   /* Initialize GDT. */
   gdt[SEL_NULL / sizeof *gdt] = 0;
@@ -43,14 +45,35 @@ gdt_init (void)
   gdt[SEL_KDSEG / sizeof *gdt] = make_data_desc (0);
   gdt[SEL_UCSEG / sizeof *gdt] = make_code_desc (3);
   gdt[SEL_UDSEG / sizeof *gdt] = make_data_desc (3);
-  gdt[SEL_TSS / sizeof *gdt] = make_tss_desc (tss_get ());
+  for (cpu = 0; cpu < CPU_MAX; cpu++)
+    gdt[SEL_TSS_CPU (cpu) / sizeof *gdt] = make_tss_desc (tss_get (cpu));
+
+  gdt_load (0);
+}
+
+/* Loads the GDT, and the TSS of cpus[CPU], on an application
+   processor. */
+void
+gdt_init_ap (unsigned cpu)
+{
+  ASSERT (cpu < CPU_MAX);
+
+  gdt_load (cpu);
+}
+
+/* Loads the GDT into the running CPU, which is cpus[CPU], along
+   with its TSS. */
+static void
+gdt_load (unsigned cpu)
+{
+  uint64_t gdtr_operand;
 
   /* Load GDTR, TR.  See [IA32-v3a] 2.4.1 "Global Descriptor
      Table Register (GDTR)", 2.4.4 "Task Register (TR)", and
      6.2.4 "Task Register".  */
   gdtr_operand = make_gdtr_operand (sizeof gdt - 1, gdt);
   asm volatile ("lgdt %0" : : "m" (gdtr_operand));
-  asm volatile ("ltr %w0" : : "q" (SEL_TSS));
+  asm volatile ("ltr %w0" : : "q" (SEL_TSS_CPU (cpu)));
 }
 
 /* System segment or code/data segment? */
@@ -2,7 +2,9 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
@@ -208,8 +210,12 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
         *pte |= PTE_A;
       else 
         {
+          /* A stale accessed bit in another CPU's TLB only
+             means that the page may look unused for a while, so
+             only this CPU's TLB is flushed. */
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          if (active_pd () == pd)
+            pagedir_activate (pd);
         }
     }
 }
@@ -219,15 +225,24 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
 void
 pagedir_activate (uint32_t *pd) 
 {
+  enum intr_level old_level;
+
   if (pd == NULL)
     pd = init_page_dir;
 
-  /* Store the physical address of the page directory into CR3
+  /* Record PD as this CPU's for cpu_flush_tlb(), which holds the
+     interrupt lock while it looks, so it sees either the old or
+     the new page directory along with the matching CR3.
+
+     Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
+  old_level = intr_disable ();
+  cpu_current ()->pagedir = pd;
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  intr_set_level (old_level);
 }
 
 /* Returns the currently active page directory. */
@@ -250,7 +265,8 @@ active_pd (void)
 
    This function invalidates the TLB if PD is the active page
    directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   the TLB, so there is no need to invalidate anything.)  Other
+   CPUs that have PD active are asked to do the same. */
 static void
 invalidate_pagedir (uint32_t *pd) 
 {
@@ -260,4 +276,5 @@ invalidate_pagedir (uint32_t *pd)
          "Translation Lookaside Buffers (TLBs)". */
       pagedir_activate (pd);
     } 
+  cpu_flush_tlb (pd);
 }
@@ -15,13 +15,65 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/slab.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#ifdef VM
+#include "vm/mmap.h"
+#endif
 
 static thread_func start_process NO_RETURN;
+static thread_func start_thread NO_RETURN;
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+static bool copy_files (struct process *child, struct process *parent);
+#endif
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+#ifndef VM
+static bool install_page (void *upage, void *kpage, bool writable);
+#endif
+static bool process_create (void);
+static void release_stack_slot (struct process *, int slot);
+static slab_ctor_func process_ctor;
+static thread_action_func interrupt_sibling;
+
+/* Processes. */
+static struct slab_cache process_cache;
+
+/* Information passed from process_thread_create() to the new
+   thread's start_thread(). */
+struct thread_start
+  {
+    struct process *process;            /* Process to join. */
+    int stack_slot;                     /* Stack slot allocated for it. */
+    void (*start) (void);               /* User entry point. */
+    void *func;                         /* First argument to START. */
+    void *aux;                          /* Second argument to START. */
+    struct semaphore started;           /* Upped when SUCCESS is set. */
+    bool success;                       /* Thread set up successfully? */
+  };
+
+#ifdef VM
+/* Information passed from process_fork() to the child's
+   start_fork(). */
+struct fork_start
+  {
+    struct process *parent;             /* Process to copy. */
+    const struct intr_frame *if_;       /* Parent's user registers. */
+    struct semaphore started;           /* Upped when SUCCESS is set. */
+    bool success;                       /* Child set up successfully? */
+  };
+#endif
+
+/* Initializes the process module. */
+void
+process_init (void)
+{
+  slab_cache_init (&process_cache, "process", sizeof (struct process),
+                   process_ctor, NULL);
+}
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
@@ -92,76 +144,425 @@ start_process (void *file_name_)
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
-
-//got rid of UNUSED
+   immediately, without waiting. */
 int
 process_wait (tid_t child_tid)
 {
-  // temporarily add infinite loop
-  int c_exit = 0;
-  struct thread *curr = thread_current();
-  struct list_elem *e;
-  struct thread *child;
-  // Pranay drove here
-  //check to see if child with given tid exists
-  for (e = list_begin (&curr->children); e != list_end (&curr->children); e = list_next (e))
+  struct child *c = thread_find_child (child_tid);
+  int exit_status;
+
+  if (c == NULL)
+    return -1;
+
+  /* If our process is exiting, we must not keep it waiting. */
+  if (!sema_down_interruptible (&c->exited))
+    return -1;
+  exit_status = c->exit_status;
+  thread_forget_child (c);
+  return exit_status;
+}
+
+/* Starts a new thread in the current process.  The thread
+   begins running user code at START, with FUNC and AUX as its
+   arguments, on a fresh stack of its own.  Returns the new
+   thread's id, which the calling thread may wait for with
+   process_wait(), or TID_ERROR if the thread cannot be
+   created. */
+tid_t
+process_thread_create (void (*start) (void), void *func, void *aux)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  struct thread_start ts;
+  tid_t tid;
+  int slot;
+
+  /* Reserve a stack slot, unless the process is on its way out. */
+  lock_acquire (&p->lock);
+  if (p->exiting)
+    {
+      lock_release (&p->lock);
+      return TID_ERROR;
+    }
+  for (slot = 1; slot < PROCESS_THREAD_MAX; slot++)
+    if ((p->stack_slots & (1u << slot)) == 0
+#ifdef VM
+        && !mmap_overlaps (p, (uint8_t *) PHYS_BASE
+                              - (slot + 1) * THREAD_STACK_SPACE,
+                           THREAD_STACK_SPACE)
+#endif
+        )
+      break;
+  if (slot >= PROCESS_THREAD_MAX)
+    {
+      lock_release (&p->lock);
+      return TID_ERROR;
+    }
+  p->stack_slots |= 1u << slot;
+  p->thread_cnt++;
+  lock_release (&p->lock);
+
+  ts.process = p;
+  ts.stack_slot = slot;
+  ts.start = start;
+  ts.func = func;
+  ts.aux = aux;
+  sema_init (&ts.started, 0);
+  tid = thread_create (cur->name, PRI_DEFAULT, start_thread, &ts);
+  if (tid == TID_ERROR)
+    {
+      release_stack_slot (p, slot);
+      return TID_ERROR;
+    }
+
+  /* TS is on our stack, so wait for the new thread to be done
+     with it.  If it failed, it gives back its slot itself. */
+  sema_down (&ts.started);
+  return ts.success ? tid : TID_ERROR;
+}
+
+/* A thread function that sets up a new thread in an existing
+   process and starts it running user code. */
+static void
+start_thread (void *ts_)
+{
+  struct thread_start *ts = ts_;
+  struct thread *t = thread_current ();
+  struct process *p = ts->process;
+  struct intr_frame if_;
+  uint8_t *upage;
+#ifndef VM
+  uint8_t *kpage;
+#endif
+  uint32_t *frame;
+  bool success;
+
+  t->process = p;
+  t->stack_slot = ts->stack_slot;
+  t->pagedir = p->pagedir;
+  t->fileDir = p->files;
+  process_activate ();
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+
+  /* Map the top page of our stack slot, and put a call frame for
+     START (FUNC, AUX) on it, with a null return address. */
+  upage = (uint8_t *) PHYS_BASE - ts->stack_slot * THREAD_STACK_SPACE - PGSIZE;
+#ifdef VM
+  success = page_add_zero (upage, true) && page_load (upage);
+#else
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  success = kpage != NULL && install_page (upage, kpage, true);
+  if (!success && kpage != NULL)
+    palloc_free_page (kpage);
+#endif
+  if (success)
     {
-      child = list_entry (e, struct thread, c_elem);
-      if (child->tid == child_tid) {
-        break;
+      /* Our page directory is active, so write through UPAGE. */
+      frame = (uint32_t *) (upage + PGSIZE) - 3;
+      frame[0] = 0;
+      frame[1] = (uint32_t) ts->func;
+      frame[2] = (uint32_t) ts->aux;
+      if_.esp = upage + PGSIZE - 3 * sizeof *frame;
+      if_.eip = ts->start;
+    }
+
+  /* TS belongs to our creator, so don't touch it after this. */
+  ts->success = success;
+  sema_up (&ts->started);
+  if (!success)
+    thread_exit ();
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+#ifdef VM
+/* Starts a child process that is a copy of the current one,
+   running the current thread alone.  The child gets copies of
+   our open files, of our memory mappings, and of our address
+   space, which shares our frames copy-on-write, and returns from
+   the system call with IF_'s registers and 0 in EAX.  Only a
+   process's first thread may fork.  Returns the child's thread
+   id, which the caller may wait for with process_wait(), or
+   TID_ERROR if the child cannot be created. */
+tid_t
+process_fork (const struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct fork_start fs;
+  tid_t tid;
+
+  /* The child's thread will be its first, with its stack in slot
+     0, where ours must be. */
+  if (cur->stack_slot != 0)
+    return TID_ERROR;
+
+  fs.parent = cur->process;
+  fs.if_ = if_;
+  sema_init (&fs.started, 0);
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &fs);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  /* FS and IF_ are on our stack, so wait for the child to be done
+     with them. */
+  sema_down (&fs.started);
+  return fs.success ? tid : TID_ERROR;
+}
+
+/* A thread function that makes a copy of a process, as described
+   in process_fork(), and starts it running user code. */
+static void
+start_fork (void *fs_)
+{
+  struct fork_start *fs = fs_;
+  struct intr_frame if_ = *fs->if_;
+  bool success;
+
+  if_.eax = 0;
+  success = (process_create ()
+             && copy_files (thread_current ()->process, fs->parent)
+             && mmap_copy (thread_current ()->process, fs->parent)
+             && page_table_copy (thread_current ()->process, fs->parent));
+
+  /* FS belongs to our parent, so don't touch it after this. */
+  fs->success = success;
+  sema_up (&fs->started);
+  if (!success)
+    thread_exit ();
+
+  process_activate ();
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives CHILD its own handles on PARENT's executable and open
+   files, at the same positions.  Returns true if successful,
+   false if memory is short. */
+static bool
+copy_files (struct process *child, struct process *parent)
+{
+  bool success = true;
+  int fd;
+
+  lock_acquire (&lock);
+  child->executable = file_reopen (parent->executable);
+  if (child->executable != NULL)
+    file_deny_write (child->executable);
+  else
+    success = false;
+  for (fd = 0; fd < FD_MAX && success; fd++)
+    if (parent->files[fd] != NULL)
+      {
+        child->files[fd] = file_reopen (parent->files[fd]);
+        if (child->files[fd] != NULL)
+          file_seek (child->files[fd], file_tell (parent->files[fd]));
+        else
+          success = false;
       }
+  lock_release (&lock);
+  return success;
+}
+#endif
+
+/* Frees the pages mapped in stack slot SLOT of process P, and
+   then the slot itself. */
+static void
+release_stack_slot (struct process *p, int slot)
+{
+  uint8_t *top = (uint8_t *) PHYS_BASE - slot * THREAD_STACK_SPACE;
+  uint8_t *upage;
+
+  for (upage = top - THREAD_STACK_SPACE; upage < top; upage += PGSIZE)
+    {
+#ifdef VM
+      page_remove (p, upage);
+#else
+      void *kpage = pagedir_get_page (p->pagedir, upage);
+      if (kpage != NULL)
+        {
+          pagedir_clear_page (p->pagedir, upage);
+          palloc_free_page (kpage);
+        }
+#endif
     }
-    //if no child return -1
-  if (e == list_end (&curr->children)) {
-    return -1;
-  }
-  // Ashish drove here
-  //blocks until child exits
-  sema_down(&(child->c_sema1));
-  c_exit = child->exit;
-  //unblocks any zombie children
-  //remove from list
-  list_remove (e);
-  sema_up(&(child->c_sema2));
-  return c_exit;
+
+  lock_acquire (&p->lock);
+  p->stack_slots &= ~(1u << slot);
+  if (--p->thread_cnt == 1)
+    cond_signal (&p->threads_done, &p->lock);
+  lock_release (&p->lock);
+}
+
+/* Creates a process for the current thread, which becomes its
+   first thread, with an empty address space and no open files.
+   Returns true if successful, false on failure. */
+static bool
+process_create (void)
+{
+  struct thread *t = thread_current ();
+  struct process *p = slab_alloc (&process_cache);
+
+  if (p == NULL)
+    return false;
+  p->pagedir = pagedir_create ();
+  if (p->pagedir == NULL)
+    {
+      slab_free (&process_cache, p);
+      return false;
+    }
+#ifdef VM
+  if (!page_table_init (p))
+    {
+      pagedir_destroy (p->pagedir);
+      slab_free (&process_cache, p);
+      return false;
+    }
+  list_init (&p->mappings);
+  p->next_mapid = 0;
+#endif
+  p->thread_cnt = 1;
+  p->stack_slots = 1;
+  p->exiting = false;
+  p->exit_status = -1;
+  p->executable = NULL;
+  memset (p->files, 0, sizeof p->files);
+
+  t->process = p;
+  t->stack_slot = 0;
+  t->pagedir = p->pagedir;
+  t->fileDir = p->files;
+  return true;
 }
 
 /* Free the current process's resources. */
 void
 process_exit (void)
 {
-
   struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  enum intr_level old_level;
   uint32_t *pd;
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
+  bool had_fs_lock;
+  int fd;
+
+  if (p == NULL)
+    return;
+
+  /* Switch back to the kernel-only page directory.  Correct
+     ordering here is crucial.  We must set cur->pagedir to NULL
+     before switching page directories, so that a timer interrupt
+     can't switch back to the process page directory.  We must
+     activate the base page directory before the process's page
+     directory is destroyed, or our active page directory will be
+     one that's been freed (and cleared). */
   pd = cur->pagedir;
-  if (pd != NULL)
+  cur->pagedir = NULL;
+  cur->fileDir = NULL;
+  cur->process = NULL;
+  pagedir_activate (NULL);
+
+  /* A thread other than the first just gives back its stack. */
+  if (cur->stack_slot != 0)
     {
-      /* Correct ordering here is crucial.  We must set
-         cur->pagedir to NULL before switching page directories,
-         so that a timer interrupt can't switch back to the
-         process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
-         that's been freed (and cleared). */
-      cur->pagedir = NULL;
-      pagedir_activate (NULL);
-      pagedir_destroy (pd);
+      release_stack_slot (p, cur->stack_slot);
+      return;
     }
+
+  /* The first thread tells the others to exit, wakes those that
+     are waiting for a futex or another thread, and waits for them
+     to finish.  Then it frees everything. */
+  lock_acquire (&p->lock);
+  p->exiting = true;
+  p->exit_status = cur->as_child != NULL ? cur->as_child->exit_status : -1;
+  lock_release (&p->lock);
+
+  old_level = intr_disable ();
+  thread_foreach (interrupt_sibling, p);
+  intr_set_level (old_level);
+
+  lock_acquire (&p->lock);
+  while (p->thread_cnt > 1)
+    cond_wait (&p->threads_done, &p->lock);
+  lock_release (&p->lock);
+
+#ifdef VM
+  /* Write back memory-mapped files. */
+  mmap_unmap_all (p);
+#endif
+
+  /* Close our open files, and allow writes to our executable
+     again.  We may have been killed in the middle of a file
+     system call. */
+  had_fs_lock = lock_held_by_current_thread (&lock);
+  if (!had_fs_lock)
+    lock_acquire (&lock);
+  for (fd = 0; fd < FD_MAX; fd++)
+    file_close (p->files[fd]);
+  file_close (p->executable);
+  if (!had_fs_lock)
+    lock_release (&lock);
+
+#ifdef VM
+  page_table_destroy (p);
+#endif
+  pagedir_destroy (pd);
+  slab_free (&process_cache, p);
+}
+
+/* Exits the running thread if its process is exiting and it is
+   not the process's first thread.  Called on every entry to the
+   kernel from user mode, and on every return to user mode. */
+void
+process_check_exiting (void)
+{
+  struct thread *t = thread_current ();
+  struct process *p = t->process;
+
+  if (p == NULL || !p->exiting || t->stack_slot == 0)
+    return;
+
+  if (t->as_child != NULL)
+    t->as_child->exit_status = p->exit_status;
+  intr_enable ();
+  thread_exit ();
+}
+
+/* Interrupts thread T if it belongs to process P_, so that it
+   stops waiting for a futex or for another thread.  P_'s first
+   thread, which is calling us, no longer belongs to it. */
+static void
+interrupt_sibling (struct thread *t, void *p_)
+{
+  if (t->process == p_)
+    thread_interrupt (t);
+}
+
+/* Constructor for struct process.  The lock and condition are
+   unused again by the time a process is freed. */
+static void
+process_ctor (void *p_)
+{
+  struct process *p = p_;
+
+  lock_init (&p->lock);
+  cond_init (&p->threads_done);
 }
 
 /* Sets up the CPU for running user code in the current
    thread.
-   This function is called on every context switch. */
+   This function is called on every context switch.  Interrupts
+   are turned off, if they are not already, so that both steps
+   happen on the same CPU. */
 void
 process_activate (void)
 {
   struct thread *t = thread_current ();
+  enum intr_level old_level = intr_disable ();
 
   /* Activate thread's page tables. */
   pagedir_activate (t->pagedir);
@@ -169,6 +570,8 @@ process_activate (void)
   /* Set thread's kernel stack for use in processing
      interrupts. */
   tss_update ();
+
+  intr_set_level (old_level);
 }
 
 /* We load ELF binaries.  The following definitions are taken
@@ -255,8 +658,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
   int i;
 
   /* Allocate and activate page directory. */
-  t->pagedir = pagedir_create ();
-  if (t->pagedir == NULL)
+  if (!process_create ())
     goto done;
   process_activate ();
 
@@ -277,6 +679,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
       printf ("load: %s: open failed\n", file_name);
       goto done;
     }
+  /* Pages are read from the executable as they are touched, so
+     it stays open as long as the process. */
+  t->process->executable = file;
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -368,7 +773,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
   success = true;
   // Joseph drove here
-  t->executableN = file;
   file_deny_write(file);
 
  done:
@@ -379,8 +783,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -438,6 +840,9 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, the pages are only entered in the
+   supplemental page table here, and read in when first touched.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -457,6 +862,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      if (!page_add_file (file, ofs, upage, page_read_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
+
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -476,6 +887,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false;
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -490,10 +902,15 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, char *filename)
 {
-  uint8_t *kpage;
   bool success = false;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#ifdef VM
+  success = (page_add_zero (((uint8_t *) PHYS_BASE) - PGSIZE, true)
+             && page_load (((uint8_t *) PHYS_BASE) - PGSIZE));
+  if (success)
+    *esp = PHYS_BASE;
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL)
     {
       success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
@@ -503,6 +920,7 @@ setup_stack (void **esp, char *filename)
         palloc_free_page (kpage);
 
     }
+#endif
 
     // Sahithi drove here
 
@@ -606,6 +1024,7 @@ setup_stack (void **esp, char *filename)
     return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -625,3 +1044,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
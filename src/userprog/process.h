@@ -1,11 +1,69 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <stdint.h>
+#include "threads/synch.h"
 #include "threads/thread.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
+/* Size of a process's file descriptor table. */
+#define FD_MAX 128
+
+/* Maximum number of threads in a process.  Each one gets a slot
+   of THREAD_STACK_SPACE bytes of user address space for its
+   stack: slot 0, the first thread's, is just below PHYS_BASE,
+   slot 1 below that, and so on.  A slot that no thread is using
+   may hold memory-mapped files instead, in which case it is not
+   given to a new thread until they are unmapped. */
+#define PROCESS_THREAD_MAX 32
+#define THREAD_STACK_SPACE (1024 * 1024)
+
+/* A user process.
+
+   All of a process's threads share its address space and its
+   open files.  The thread that was started by exec() is the
+   process's first thread.  It owns the process: when it exits,
+   it tells the process's other threads to exit, waits for them
+   to do so, then frees the process's resources, and only then
+   is its parent's wait() for it satisfied.
+
+   The other threads notice on their next entry to or return from
+   the kernel, and those waiting in futex_wait() or for another
+   thread are woken to do so.  This way, a thread that loops in
+   user code or waits for a futex that no one will wake can't
+   keep its process from exiting. */
+struct process
+  {
+    struct lock lock;                   /* Protects the members below. */
+    int thread_cnt;                     /* Number of threads. */
+    uint32_t stack_slots;               /* Bit N set if slot N is in use. */
+    struct condition threads_done;      /* Signaled when thread_cnt is 1. */
+    bool exiting;                       /* First thread has exited? */
+    int exit_status;                    /* First thread's exit status. */
+
+    uint32_t *pagedir;                  /* Page directory. */
+#ifdef VM
+    struct page_table pages;            /* Supplemental page table. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping identifier. */
+#endif
+    struct file *executable;            /* Executable, denied writes. */
+    struct file *files[FD_MAX];         /* Open files, indexed by fd. */
+  };
+
+void process_init (void);
 tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (void);
+void process_check_exiting (void);
 void process_activate (void);
 
+tid_t process_thread_create (void (*start) (void), void *func, void *aux);
+#ifdef VM
+struct intr_frame;
+tid_t process_fork (const struct intr_frame *);
+#endif
+
 #endif /* userprog/process.h */
@@ -1,4 +1,5 @@
 #include "userprog/syscall.h"
+#include "userprog/futex.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
 #include <stdio.h>
@@ -13,6 +14,10 @@
 #include "filesys/off_t.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 // syscall methods
 static void syscall_handler (struct intr_frame *);
@@ -29,17 +34,24 @@ void close (int fd);
 int read (int fd, void *buffer, unsigned size); 
 int open (const char *file);
 int filesize (int fd);
+#ifdef VM
+int mmap (int fd, void *addr);
+void munmap (int mapid);
+#endif
 // lock to block calls to filesys
 
 // helper method to check for valid user address
 bool check_valid(char* cmd_line);
+// helper method to check every page of a user buffer
+bool check_buffer(const void* buffer, unsigned size);
 
 // initialize the syscall handler
 void
 syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init(&lock);
+  lock_init_named (&lock, "file system");
+  futex_init ();
 }
 
 static void
@@ -47,6 +59,10 @@ syscall_handler (struct intr_frame *f UNUSED)
 {
   // stores syscall number
   int* myEsp = f->esp;
+  // saved for page faults taken on the user's behalf
+  thread_current ()->user_esp = f->esp;
+  // leave now if another thread is taking our process down
+  process_check_exiting ();
   // variables used multiple times throughout syscall_handler
   int fd;
   char* file;
@@ -153,6 +169,53 @@ syscall_handler (struct intr_frame *f UNUSED)
       fd = *myEsp;
       close(fd);
       break;
+    case SYS_FUTEX_WAIT:
+    case SYS_FUTEX_WAKE:
+      {
+        int *uaddr;
+        int arg;
+        if (!check_valid ((char *) (myEsp + 2)))
+          exit (-1);
+        uaddr = (int *) myEsp[1];
+        arg = myEsp[2];
+        if (!check_valid ((char *) uaddr))
+          exit (-1);
+        f->eax = (*myEsp == SYS_FUTEX_WAIT
+                  ? futex_wait (uaddr, arg) : futex_wake (uaddr, arg));
+      }
+      break;
+    case SYS_THREAD_CREATE:
+      if (!check_valid ((char *) (myEsp + 3)))
+        exit (-1);
+      f->eax = process_thread_create ((void (*) (void)) myEsp[1],
+                                      (void *) myEsp[2], (void *) myEsp[3]);
+      break;
+#ifdef VM
+    case SYS_MMAP:
+      if (!check_valid ((char *) (myEsp + 2)))
+        exit (-1);
+      f->eax = mmap (myEsp[1], (void *) myEsp[2]);
+      break;
+    case SYS_MUNMAP:
+      if (!check_valid ((char *) (myEsp + 1)))
+        exit (-1);
+      munmap (myEsp[1]);
+      break;
+#endif
+    case SYS_THREAD_JOIN:
+      if (!check_valid ((char *) (myEsp + 1)))
+        exit (-1);
+      /* Threads are children of the thread that created them. */
+      f->eax = wait (myEsp[1]);
+      break;
+    case SYS_FORK:
+#ifdef VM
+      f->eax = process_fork (f);
+#else
+      // copying an address space needs the supplemental page table
+      f->eax = TID_ERROR;
+#endif
+      break;
   }
 }
 
@@ -168,12 +231,17 @@ exit (int status)
 {
   // Sahithi drove here
   struct thread *curr = thread_current();
-  curr->exit = status;
-  // Ashish drove here
-  // make a copy of the thread name and print it with it's exit status
-  char* save_ptr;
-  char* name_cpy = strtok_r (curr->name, " ", &save_ptr);
-  printf ("%s: exit(%d)\n", name_cpy, status);
+  if (curr->as_child != NULL)
+    curr->as_child->exit_status = status;
+  /* Only a process's first thread's exit ends the process. */
+  if (curr->stack_slot == 0)
+    {
+      // Ashish drove here
+      // make a copy of the thread name and print it with it's exit status
+      char* save_ptr;
+      char* name_cpy = strtok_r (curr->name, " ", &save_ptr);
+      printf ("%s: exit(%d)\n", name_cpy, status);
+    }
   thread_exit();
 }
 
@@ -252,12 +320,14 @@ open (const char *file)
   bool notFound = 1;
   int index = 2;
   // opens the file and blocks the filesys call with locks
+  // the file table is shared by the process's threads, so hold
+  // the lock until the file has a slot in it
   lock_acquire(&lock);
   struct file *fp = filesys_open(file);
-  lock_release(&lock);
   struct thread *curr = thread_current();
   if (fp == NULL)
   {
+    lock_release(&lock);
     return -1;
   }
   else
@@ -281,8 +351,11 @@ open (const char *file)
   // if no space is found, return -1
   if (notFound)
   {
+    file_close(fp);
+    lock_release(&lock);
     return -1;
   }
+  lock_release(&lock);
   return index;
 }
 
@@ -311,10 +384,18 @@ int
 read (int fd, void* buffer, unsigned size)
 {
   // Sahithi drove here
-  if (!check_valid(buffer) || (fd < 0 || fd > 127)) 
+  if (!check_buffer(buffer, size) || (fd < 0 || fd > 127)) 
   {
     exit(-1);
   }
+#ifdef VM
+  // the kernel ignores page protection, so don't let it store
+  // into read-only pages, which may be shared with other processes
+  if (!page_writable (buffer, size))
+  {
+    exit(-1);
+  }
+#endif
   // variable to count number of bytes
   int noBytes = 0;
   struct thread *curr = thread_current();
@@ -337,10 +418,23 @@ read (int fd, void* buffer, unsigned size)
   else 
   {  
     // otherwise, call file_read to get number of bytes
-     struct file *file = curr->fileDir[fd];
+#ifdef VM
+     // keep the buffer in memory while we hold the fs lock, and
+     // copy any pages shared copy-on-write, since storing into them
+     // from the kernel wouldn't fault
+     if (!page_pin (buffer, size, true))
+     {
+       page_unpin (buffer, size);
+       return -1;
+     }
+#endif
      lock_acquire(&lock);
+     struct file *file = curr->fileDir[fd];
      noBytes = (int)file_read(file, buffer, size);
      lock_release(&lock);
+#ifdef VM
+     page_unpin (buffer, size);
+#endif
   }
   
   return noBytes;
@@ -350,7 +444,7 @@ int
 write (int fd, const void *buffer, unsigned size)
 {
   // Joseph drove here
-  if (!check_valid(buffer) || (fd < 0 || fd > 127)) 
+  if (!check_buffer(buffer, size) || (fd < 0 || fd > 127)) 
   {
     exit(-1);
   }
@@ -386,10 +480,16 @@ write (int fd, const void *buffer, unsigned size)
     // Joseph drove here
     // otherwise, call file_write
      noBytes = 0;
-     struct file *file = curr->fileDir[fd];
+#ifdef VM
+     page_pin (buffer, size, false);
+#endif
      lock_acquire(&lock);
+     struct file *file = curr->fileDir[fd];
      noBytes = (int)file_write(file, buffer, size);
      lock_release(&lock);
+#ifdef VM
+     page_unpin (buffer, size);
+#endif
   }
   return noBytes;
 }
@@ -458,6 +558,31 @@ close (int fd)
   lock_release(&lock);
 }
 
+#ifdef VM
+// maps the file open as fd into memory at addr
+int
+mmap (int fd, void *addr)
+{
+  if (fd < 2 || fd > 127)
+  {
+    return -1;
+  }
+  struct file *file = thread_current ()->fileDir[fd];
+  if (file == NULL)
+  {
+    return -1;
+  }
+  return mmap_map (file, addr);
+}
+
+// removes a mapping made by mmap, writing back its dirty pages
+void
+munmap (int mapid)
+{
+  mmap_unmap (thread_current ()->process, mapid);
+}
+#endif
+
 // helper method that checks if ptr is valid
 bool
 check_valid(char* cmd_line)
@@ -473,8 +598,38 @@ check_valid(char* cmd_line)
   // checks for valid page directory
   else if (pagedir_get_page (curr->pagedir, cmd_line) == NULL)
   {
+#ifdef VM
+    // the page may just not have been touched yet, so bring it
+    // in now rather than fault on it later with the fs lock held
+    return (page_load (cmd_line)
+            || page_grow_stack (cmd_line, curr->user_esp));
+#else
     return false;
+#endif
   }
   // otherwise is valid
   return true;
 }
+
+// checks that all of the SIZE bytes at BUFFER are valid user
+// memory, so that file_read and file_write can't fault on them
+bool
+check_buffer (const void* buffer, unsigned size)
+{
+  const char *end = (const char *) buffer + size;
+  const char *page;
+
+  if (!check_valid ((char *) buffer))
+  {
+    return false;
+  }
+  for (page = (const char *) pg_round_down (buffer) + PGSIZE;
+       page < end && page > (const char *) buffer; page += PGSIZE)
+  {
+    if (!check_valid ((char *) page))
+    {
+      return false;
+    }
+  }
+  return true;
+}
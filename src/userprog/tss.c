@@ -2,6 +2,8 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -72,35 +74,45 @@ struct tss
     uint16_t trace, bitmap;
   };
 
-/* Kernel TSS. */
+/* Kernel TSSes, one for each CPU, since each CPU runs a
+   different thread and so needs its own ring 0 stack. */
 static struct tss *tss;
 
-/* Initializes the kernel TSS. */
+/* Initializes the kernel TSSes. */
 void
 tss_init (void) 
 {
+  size_t i;
+
   /* Our TSS is never used in a call gate or task gate, so only a
      few fields of it are ever referenced, and those are the only
      ones we initialize. */
+  ASSERT (CPU_MAX * sizeof *tss <= PGSIZE);
   tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
-  tss->ss0 = SEL_KDSEG;
-  tss->bitmap = 0xdfff;
+  for (i = 0; i < CPU_MAX; i++)
+    {
+      tss[i].ss0 = SEL_KDSEG;
+      tss[i].bitmap = 0xdfff;
+    }
   tss_update ();
 }
 
-/* Returns the kernel TSS. */
+/* Returns the kernel TSS for cpus[CPU]. */
 struct tss *
-tss_get (void) 
+tss_get (unsigned cpu) 
 {
   ASSERT (tss != NULL);
-  return tss;
+  ASSERT (cpu < CPU_MAX);
+  return &tss[cpu];
 }
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
-   of the thread stack. */
+/* Sets the ring 0 stack pointer in the running CPU's TSS to
+   point to the end of the thread stack.  Interrupts must be
+   off, so that the thread cannot move to another CPU. */
 void
 tss_update (void) 
 {
   ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  ASSERT (intr_get_level () == INTR_OFF);
+  tss[cpu_current ()->id].esp0 = (uint8_t *) thread_current () + PGSIZE;
 }
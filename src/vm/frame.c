@@ -0,0 +1,609 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* Frame table, the clock hand that sweeps it, and the table of
+   shared frames.  Protected by frame_lock, as are each frame's
+   list of pages and pin count.
+
+   The rest of a page's state is managed under its process's
+   page table lock, which an evicting thread only ever tries to
+   acquire, never waits for, so that two processes evicting each
+   other's pages cannot deadlock.  A process's own frames can be
+   chosen by a thread that already holds its lock. */
+static struct list frames;
+static struct list_elem *hand;
+static size_t frame_cnt;
+static struct hash shared_frames;
+static struct lock frame_lock;
+
+/* Signaled when evict() is done with a frame that it left in the
+   shared frame table while it wrote the frame's pages back. */
+static struct condition evicted;
+
+/* Frames. */
+static struct slab_cache frame_cache;
+
+/* Gives lent pages back to the kernel pool in the background. */
+static struct work reclaim_work;
+
+/* Statistics. */
+static size_t frame_max;                /* Most frames ever in use. */
+static unsigned long long evict_cnt;    /* Frames evicted. */
+static unsigned long long share_cnt;    /* Pages mapped to shared frames. */
+static unsigned long long copy_cnt;     /* Frames copied on write. */
+static unsigned long long reclaim_cnt;  /* Frames given back to kernel. */
+
+static struct frame *get_frame (bool zero);
+static struct frame *evict (bool lent_only);
+static bool lock_owners (struct frame *, struct process *self);
+static void unlock_owner (struct page *, struct process *self);
+static bool test_and_clear_accessed (struct frame *);
+static struct frame *clock_next (void);
+static void insert_frame (struct frame *);
+static void remove_frame (struct frame *);
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+static work_func reclaim_worker;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frames);
+  hand = list_end (&frames);
+  if (!hash_init (&shared_frames, frame_hash, frame_less, NULL))
+    PANIC ("frame: shared frame table creation failed");
+  lock_init (&frame_lock);
+  cond_init (&evicted);
+  slab_cache_init (&frame_cache, "frame", sizeof (struct frame), NULL, NULL);
+  work_init (&reclaim_work, reclaim_worker, NULL, WORK_NORMAL);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frame: %zu frames in use (peak %zu), %llu evicted, "
+          "%llu given back to kernel, %llu pages shared, "
+          "%llu copied on write\n",
+          frame_cnt, frame_max, evict_cnt, reclaim_cnt, share_cnt, copy_cnt);
+}
+
+/* Allocates a frame to hold page PG, evicting another page if
+   the user pool is empty.  The frame is zeroed if ZERO is true.
+   Returns the frame, pinned, or a null pointer if no frame could
+   be freed.  The caller must hold PG's page table lock. */
+struct frame *
+frame_alloc (struct page *pg, bool zero)
+{
+  struct frame *f = get_frame (zero);
+
+  if (f == NULL)
+    return NULL;
+  lock_acquire (&frame_lock);
+  list_push_back (&f->pages, &pg->frame_elem);
+  insert_frame (f);
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Adds page PG to frame F, which already holds a page of the
+   process that PG is being copied from.  The caller must hold
+   the page table locks of both processes. */
+void
+frame_add (struct frame *f, struct page *pg)
+{
+  lock_acquire (&frame_lock);
+  list_push_back (&f->pages, &pg->frame_elem);
+  share_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Gives page PG a frame of its own, if its frame is shared with
+   other pages, by copying the frame's data into a new frame and
+   moving PG there.  Returns PG's frame, which may be the frame it
+   was already in if no other page is left in it, or a null
+   pointer if no frame could be freed.  The caller must hold PG's
+   page table lock. */
+struct frame *
+frame_unshare (struct page *pg)
+{
+  struct frame *old = pg->frame;
+  struct frame *f;
+  bool last;
+
+  lock_acquire (&frame_lock);
+  if (list_begin (&old->pages) == list_rbegin (&old->pages))
+    {
+      lock_release (&frame_lock);
+      return old;
+    }
+
+  /* Keep OLD from being evicted while we get a frame to copy it
+     into. */
+  old->pin_cnt++;
+  lock_release (&frame_lock);
+
+  f = get_frame (false);
+  if (f != NULL)
+    memcpy (f->kpage, old->kpage, PGSIZE);
+
+  lock_acquire (&frame_lock);
+  old->pin_cnt--;
+  if (f == NULL)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+  list_remove (&pg->frame_elem);
+  list_push_back (&f->pages, &pg->frame_elem);
+  insert_frame (f);
+  copy_cnt++;
+
+  /* A pinned page takes its pin along. */
+  f->pin_cnt = 0;
+  if (pg->pinned)
+    {
+      old->pin_cnt--;
+      f->pin_cnt++;
+    }
+  last = list_empty (&old->pages);
+  if (last)
+    remove_frame (old);
+  lock_release (&frame_lock);
+
+  /* The other pages may have let go of OLD while we copied. */
+  if (last)
+    {
+      palloc_free_page (old->kpage);
+      slab_free (&frame_cache, old);
+    }
+  return f;
+}
+
+/* Looks for a shared frame that holds LENGTH bytes of INODE's
+   data starting at offset OFS, followed by zeros, memory-mapped
+   if MAPPED is true or read-only otherwise.  If there is one,
+   adds PG to it and returns it, pinned.  Otherwise, returns a
+   null pointer.  The caller must hold PG's page table lock.
+
+   If the frame is being evicted, waits until it is gone, so
+   that we don't read the file before its dirty data is written
+   back. */
+struct frame *
+frame_share (struct page *pg, struct inode *inode, off_t ofs,
+             uint32_t length, bool mapped)
+{
+  struct frame key, *f = NULL;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.length = length;
+  key.mapped = mapped;
+  lock_acquire (&frame_lock);
+  while ((e = hash_find (&shared_frames, &key.share_elem)) != NULL
+         && hash_entry (e, struct frame, share_elem)->evicting)
+    cond_wait (&evicted, &frame_lock);
+  if (e != NULL)
+    {
+      f = hash_entry (e, struct frame, share_elem);
+      list_push_back (&f->pages, &pg->frame_elem);
+      f->pin_cnt++;
+      share_cnt++;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Offers F, which holds page PG and nothing else, for sharing
+   with frame_share().  F must hold LENGTH bytes of INODE's data
+   from offset OFS followed by zeros.  Unless MAPPED is true, the
+   data must never be modified.
+
+   Someone else may have published the same data while we read
+   it, in which case PG moves to their frame, F is freed, and
+   that frame is returned, pinned, so that all the pages of a
+   mapped file see the same copy.  If that frame was being
+   evicted, what we read may predate its writes, so F is freed
+   and, if the frame is gone when eviction is done, a null
+   pointer is returned, and the caller must start over.
+   Otherwise, returns F. */
+struct frame *
+frame_publish (struct frame *f, struct page *pg, struct inode *inode,
+               off_t ofs, uint32_t length, bool mapped)
+{
+  struct frame *first = NULL;
+  struct hash_elem *e;
+  bool stale = false;
+
+  lock_acquire (&frame_lock);
+  f->inode = inode;
+  f->ofs = ofs;
+  f->length = length;
+  f->mapped = mapped;
+  while ((e = hash_find (&shared_frames, &f->share_elem)) != NULL
+         && hash_entry (e, struct frame, share_elem)->evicting)
+    {
+      stale = true;
+      cond_wait (&evicted, &frame_lock);
+    }
+  if (e == NULL && !stale)
+    {
+      hash_insert (&shared_frames, &f->share_elem);
+      lock_release (&frame_lock);
+      return f;
+    }
+
+  f->inode = NULL;
+  list_remove (&pg->frame_elem);
+  remove_frame (f);
+  if (e != NULL)
+    {
+      first = hash_entry (e, struct frame, share_elem);
+      list_push_back (&first->pages, &pg->frame_elem);
+      first->pin_cnt++;
+      share_cnt++;
+    }
+  lock_release (&frame_lock);
+
+  palloc_free_page (f->kpage);
+  slab_free (&frame_cache, f);
+  return first;
+}
+
+/* Removes page PG from frame F, and frees F if no other page is
+   in it.  The caller must hold PG's page table lock. */
+void
+frame_release (struct frame *f, struct page *pg)
+{
+  bool last;
+
+  lock_acquire (&frame_lock);
+  list_remove (&pg->frame_elem);
+  last = list_empty (&f->pages);
+  if (last)
+    remove_frame (f);
+  lock_release (&frame_lock);
+
+  if (last)
+    {
+      palloc_free_page (f->kpage);
+      slab_free (&frame_cache, f);
+    }
+}
+
+/* Keeps F from being evicted until a matching frame_unpin(). */
+void
+frame_pin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->pin_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Undoes a frame_pin(). */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Gives a page that the kernel pool lent to the user pool back
+   to it, by evicting the user page in it, for when the kernel
+   pool runs out.  Returns true if a page was given back, false
+   if no lent frame could be evicted.
+
+   Eviction may wait for locks and for the disk, so if the caller
+   must not sleep, or holds a lock, which eviction might need,
+   this hands the job to a worker thread instead and returns
+   false. */
+bool
+frame_reclaim (void)
+{
+  struct frame *f;
+
+  if (frame_cnt == 0)
+    return false;
+  if (intr_context () || intr_get_level () == INTR_OFF
+      || !list_empty (&thread_current ()->held_locks))
+    {
+      frame_reclaim_later ();
+      return false;
+    }
+
+  f = evict (true);
+  if (f == NULL)
+    return false;
+  palloc_free_page (f->kpage);
+  slab_free (&frame_cache, f);
+  reclaim_cnt++;
+  return true;
+}
+
+/* Has a worker thread give pages that the kernel pool lent back
+   to it, until the kernel pool is back above its reserve of free
+   pages.  May be called from an interrupt handler. */
+void
+frame_reclaim_later (void)
+{
+  if (frame_cnt > 0)
+    work_queue (&reclaim_work);
+}
+
+/* Work function for frame_reclaim_later(). */
+static void
+reclaim_worker (struct work *w UNUSED)
+{
+  while (palloc_kernel_low () && frame_reclaim ())
+    continue;
+}
+
+/* Returns a frame, pinned and holding no pages, that is not yet
+   in the frame table, evicting another page if the user pool is
+   empty.  Only if nothing can be evicted is a page borrowed from
+   the kernel pool, which needs its pages more than we do.  The
+   frame is zeroed if ZERO is true.  Returns a null pointer if no
+   frame could be freed. */
+static struct frame *
+get_frame (bool zero)
+{
+  enum palloc_flags flags = PAL_USER | (zero ? PAL_ZERO : 0);
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (flags | PAL_NOBORROW);
+  if (kpage == NULL && (f = evict (false)) != NULL)
+    {
+      if (zero)
+        memset (f->kpage, 0, PGSIZE);
+    }
+  else
+    {
+      if (kpage == NULL)
+        kpage = palloc_get_page (flags);
+      if (kpage == NULL)
+        return NULL;
+      f = slab_alloc (&frame_cache);
+      if (f == NULL)
+        {
+          palloc_free_page (kpage);
+          return NULL;
+        }
+      f->kpage = kpage;
+      list_init (&f->pages);
+    }
+  f->pin_cnt = 1;
+  f->inode = NULL;
+  f->evicting = false;
+  return f;
+}
+
+/* Chooses a frame with the clock algorithm, writes its pages
+   out, and returns the frame, removed from the frame table and
+   holding no pages.  If LENT_ONLY is true, only frames in pages
+   that the kernel pool lent are chosen.  Returns a null pointer
+   if there is no frame to evict.
+
+   Frames that were accessed since the hand last passed get a
+   second chance, unless LENT_ONLY is true.  Frames that are
+   pinned, or whose owners' page tables are busy, are passed
+   over. */
+static struct frame *
+evict (bool lent_only)
+{
+  struct process *self = thread_current ()->process;
+  size_t i;
+
+  if (self != NULL && !lock_held_by_current_thread (&self->pages.lock))
+    self = NULL;
+
+  lock_acquire (&frame_lock);
+  for (i = 0; i < 2 * frame_cnt + 1 && frame_cnt > 0; i++)
+    {
+      struct frame *f = clock_next ();
+      struct list_elem *e;
+      bool written = true;
+
+      if (f->pin_cnt > 0 || (lent_only && !palloc_page_lent (f->kpage))
+          || !lock_owners (f, self))
+        continue;
+
+      if (test_and_clear_accessed (f) && !lent_only)
+        {
+          for (e = list_begin (&f->pages); e != list_end (&f->pages);
+               e = list_next (e))
+            unlock_owner (list_entry (e, struct page, frame_elem), self);
+          continue;
+        }
+
+      /* A mapped frame stays in the shared frame table until its
+         pages are written back, so that no one reads the file in
+         the meantime. */
+      f->evicting = f->inode != NULL && f->mapped;
+      remove_frame (f);
+      lock_release (&frame_lock);
+
+      while (written && !list_empty (&f->pages))
+        {
+          struct page *pg = list_entry (list_front (&f->pages),
+                                        struct page, frame_elem);
+          written = page_out (pg);
+          if (written)
+            {
+              list_pop_front (&f->pages);
+              unlock_owner (pg, self);
+            }
+        }
+
+      lock_acquire (&frame_lock);
+      if (f->evicting)
+        {
+          f->evicting = false;
+          if (written)
+            {
+              hash_delete (&shared_frames, &f->share_elem);
+              f->inode = NULL;
+            }
+          cond_broadcast (&evicted, &frame_lock);
+        }
+      if (written)
+        {
+          lock_release (&frame_lock);
+          evict_cnt++;
+          return f;
+        }
+
+      /* Couldn't write it out, so put it back before letting its
+         owners at it again. */
+      insert_frame (f);
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        unlock_owner (list_entry (e, struct page, frame_elem), self);
+    }
+  lock_release (&frame_lock);
+  return NULL;
+}
+
+/* Acquires the page table locks of the processes whose pages are
+   in F, except SELF's, which the caller already holds.  Returns
+   true if successful, false if any of them is busy, in which
+   case none are held. */
+static bool
+lock_owners (struct frame *f, struct process *self)
+{
+  struct list_elem *e, *e2;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct process *p = list_entry (e, struct page, frame_elem)->process;
+      if (p != self && !lock_try_acquire (&p->pages.lock))
+        {
+          for (e2 = list_begin (&f->pages); e2 != e; e2 = list_next (e2))
+            unlock_owner (list_entry (e2, struct page, frame_elem), self);
+          return false;
+        }
+    }
+  return true;
+}
+
+/* Releases the page table lock of PG's process, unless that is
+   SELF. */
+static void
+unlock_owner (struct page *pg, struct process *self)
+{
+  if (pg->process != self)
+    lock_release (&pg->process->pages.lock);
+}
+
+/* Returns true if any page in F was accessed since the last
+   call, and clears their accessed bits.  The page table locks of
+   F's owners must be held. */
+static bool
+test_and_clear_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *pg = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = pg->process->pagedir;
+      if (pagedir_is_accessed (pd, pg->upage))
+        {
+          pagedir_set_accessed (pd, pg->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Returns the frame under the clock hand and advances the hand.
+   The frame table must not be empty. */
+static struct frame *
+clock_next (void)
+{
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (!list_empty (&frames));
+
+  if (hand == list_end (&frames))
+    hand = list_begin (&frames);
+  f = list_entry (hand, struct frame, elem);
+  hand = list_next (hand);
+  return f;
+}
+
+/* Adds F to the frame table. */
+static void
+insert_frame (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  list_push_back (&frames, &f->elem);
+  if (++frame_cnt > frame_max)
+    frame_max = frame_cnt;
+}
+
+/* Removes F from the frame table, and from the shared frame
+   table if it is there and not being evicted, moving the clock
+   hand off it if necessary. */
+static void
+remove_frame (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+  frame_cnt--;
+  if (f->inode != NULL && !f->evicting)
+    {
+      hash_delete (&shared_frames, &f->share_elem);
+      f->inode = NULL;
+    }
+}
+
+/* Returns a hash value for the shared frame E. */
+static unsigned
+frame_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, share_elem);
+  return (hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs)
+          ^ f->mapped);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  if (a->length != b->length)
+    return a->length < b->length;
+  return a->mapped < b->mapped;
+}
@@ -0,0 +1,67 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct page;
+
+/* A frame: a page of the user pool that holds a user page.
+
+   All of the frames in use are kept in one list, the frame
+   table, through which a "clock" hand sweeps to choose a frame
+   to evict when the user pool runs out of pages.
+
+   A frame usually holds one page of one process.  A frame that
+   holds read-only data from a file is also entered in a hash
+   table, keyed on the file's inode and the offset and length of
+   the data, so that other processes that map the same data,
+   such as other instances of the same program, can share it.
+   So is a page of a memory-mapped file, which every process that
+   maps the same part of the file shares, writes and all, until
+   it is evicted and written back.  The two kinds are kept apart,
+   because a program's read-only data must never change.
+
+   After fork(), a frame also holds the same page of a parent and
+   its child, mapped read-only in both, until one of them writes
+   to it and gets a copy of its own from frame_unshare().  The
+   length of the page list serves as the frame's reference
+   count. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages held in this frame. */
+    int pin_cnt;                /* Evictable only if zero. */
+    struct list_elem elem;      /* Element in frame table. */
+
+    /* Shared file data. */
+    struct inode *inode;        /* File's inode, or null if not shared. */
+    off_t ofs;                  /* Offset of data in file. */
+    uint32_t length;            /* Length of data, rest is zeros. */
+    bool mapped;                /* Memory-mapped, so writable? */
+    bool evicting;              /* Being written back by evict()? */
+    struct hash_elem share_elem; /* Element in shared frame table. */
+  };
+
+void frame_init (void);
+void frame_print_stats (void);
+
+struct frame *frame_alloc (struct page *, bool zero);
+struct frame *frame_share (struct page *, struct inode *, off_t ofs,
+                           uint32_t length, bool mapped);
+struct frame *frame_publish (struct frame *, struct page *,
+                             struct inode *, off_t ofs, uint32_t length,
+                             bool mapped);
+void frame_add (struct frame *, struct page *);
+struct frame *frame_unshare (struct page *);
+void frame_release (struct frame *, struct page *);
+void frame_pin (struct frame *);
+void frame_unpin (struct frame *);
+bool frame_reclaim (void);
+void frame_reclaim_later (void);
+
+#endif /* vm/frame.h */
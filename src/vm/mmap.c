@@ -0,0 +1,261 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+
+static bool overlaps_stack (struct process *, const void *addr,
+                            size_t size);
+static void unmap (struct process *, struct mapping *);
+static void release (struct mapping *);
+
+/* Maps all of FILE into the current process's address space,
+   starting at page-aligned user address ADDR.  Returns the new
+   mapping's identifier, or -1 if FILE is empty, if ADDR is not a
+   valid place for it, or if memory is short. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct process *p = thread_current ()->process;
+  struct mapping *m;
+  off_t length = 0;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || !is_user_vaddr (addr))
+    return -1;
+
+  /* Our own handle keeps the mapping valid after FILE is closed. */
+  lock_acquire (&lock);
+  file = file_reopen (file);
+  if (file != NULL)
+    length = file_length (file);
+  lock_release (&lock);
+  if (file == NULL)
+    return -1;
+
+  /* Holding P's lock keeps a new thread from taking a stack slot
+     that we are mapping into. */
+  lock_acquire (&p->lock);
+  m = malloc (sizeof *m);
+  if (m == NULL || length == 0
+      || (size_t) length > (size_t) ((uint8_t *) PHYS_BASE
+                                     - (uint8_t *) addr)
+      || overlaps_stack (p, addr, length))
+    goto error;
+  m->file = file;
+  m->base = addr;
+  m->page_cnt = 0;
+  m->unmapping = false;
+
+  /* Fails if any page is already in use. */
+  for (i = 0; (off_t) (i * PGSIZE) < length; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+      if (!page_add_mapped (file, ofs, (uint8_t *) addr + ofs, read_bytes))
+        goto error;
+      m->page_cnt++;
+    }
+
+  m->id = p->next_mapid++;
+  list_push_back (&p->mappings, &m->elem);
+  lock_release (&p->lock);
+  return m->id;
+
+ error:
+  lock_release (&p->lock);
+  if (m != NULL)
+    {
+      for (i = 0; i < m->page_cnt; i++)
+        page_remove (p, (uint8_t *) addr + i * PGSIZE);
+      free (m);
+    }
+  lock_acquire (&lock);
+  file_close (file);
+  lock_release (&lock);
+  return -1;
+}
+
+/* Removes mapping ID from process P, writing back its dirty
+   pages.  Does nothing if P has no such mapping. */
+void
+mmap_unmap (struct process *p, int id)
+{
+  struct mapping *m = NULL;
+  struct list_elem *e;
+
+  lock_acquire (&p->lock);
+  for (e = list_begin (&p->mappings); e != list_end (&p->mappings);
+       e = list_next (e))
+    if (list_entry (e, struct mapping, elem)->id == id
+        && !list_entry (e, struct mapping, elem)->unmapping)
+      {
+        m = list_entry (e, struct mapping, elem);
+        m->unmapping = true;
+        break;
+      }
+  lock_release (&p->lock);
+  if (m == NULL)
+    return;
+
+  /* M stays in the list, keeping new threads out of its pages,
+     until they are gone.  We can't hold P's lock meanwhile,
+     because writing the pages back needs the file system lock,
+     which comes first. */
+  unmap (p, m);
+
+  lock_acquire (&p->lock);
+  list_remove (&m->elem);
+  lock_release (&p->lock);
+  release (m);
+}
+
+/* Removes all of P's mappings, writing back their dirty pages.
+   P's other threads must have exited. */
+void
+mmap_unmap_all (struct process *p)
+{
+  while (!list_empty (&p->mappings))
+    {
+      struct mapping *m = list_entry (list_pop_front (&p->mappings),
+                                      struct mapping, elem);
+      unmap (p, m);
+      release (m);
+    }
+}
+
+/* Gives CHILD a copy of each of PARENT's mappings, for fork(),
+   with its own handle on the mapped file.  The pages are copied
+   separately, by page_table_copy(), which looks up their files
+   in CHILD with mmap_file().  Returns true if successful, false
+   if memory is short, in which case CHILD has the mappings
+   copied so far. */
+bool
+mmap_copy (struct process *child, struct process *parent)
+{
+  struct list_elem *e;
+  bool success = true;
+
+  /* The file system lock comes before process locks. */
+  lock_acquire (&lock);
+  lock_acquire (&parent->lock);
+  child->next_mapid = parent->next_mapid;
+  for (e = list_begin (&parent->mappings);
+       e != list_end (&parent->mappings) && success; e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      struct mapping *copy;
+
+      /* Its pages may be partly gone already. */
+      if (m->unmapping)
+        continue;
+
+      copy = malloc (sizeof *copy);
+      success = copy != NULL;
+      if (success)
+        {
+          *copy = *m;
+          copy->file = file_reopen (m->file);
+          success = copy->file != NULL;
+          if (success)
+            list_push_back (&child->mappings, &copy->elem);
+          else
+            free (copy);
+        }
+    }
+  lock_release (&parent->lock);
+  lock_release (&lock);
+  return success;
+}
+
+/* Returns the file that P maps at UPAGE, or a null pointer if P
+   has no mapping there.  P's mappings must not be changing, so P
+   must be a process being set up by fork(). */
+struct file *
+mmap_file (struct process *p, const void *upage)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&p->mappings); e != list_end (&p->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      const uint8_t *base = m->base;
+      if ((const uint8_t *) upage >= base
+          && (const uint8_t *) upage < base + m->page_cnt * PGSIZE)
+        return m->file;
+    }
+  return NULL;
+}
+
+/* Returns true if any of P's mappings overlaps the SIZE bytes
+   starting at ADDR.  P's lock must be held. */
+bool
+mmap_overlaps (struct process *p, const void *addr, size_t size)
+{
+  const uint8_t *start = addr;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+
+  for (e = list_begin (&p->mappings); e != list_end (&p->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      const uint8_t *base = m->base;
+      if (start < base + m->page_cnt * PGSIZE && base < start + size)
+        return true;
+    }
+  return false;
+}
+
+/* Returns true if the SIZE bytes starting at ADDR overlap the
+   stack slot of any of P's threads.  P's lock must be held. */
+static bool
+overlaps_stack (struct process *p, const void *addr, size_t size)
+{
+  const uint8_t *start = addr;
+  int slot;
+
+  for (slot = 0; slot < PROCESS_THREAD_MAX; slot++)
+    if (p->stack_slots & (1u << slot))
+      {
+        const uint8_t *top = (uint8_t *) PHYS_BASE
+                              - slot * THREAD_STACK_SPACE;
+        if (start < top && top - THREAD_STACK_SPACE < start + size)
+          return true;
+      }
+  return false;
+}
+
+/* Removes the pages of M from P, writing back those that are
+   dirty. */
+static void
+unmap (struct process *p, struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (p, (uint8_t *) m->base + i * PGSIZE);
+}
+
+/* Closes M's file and frees M, which is no longer in any list. */
+static void
+release (struct mapping *m)
+{
+  bool had_fs_lock;
+
+  /* We may be exiting in the middle of a file system call. */
+  had_fs_lock = lock_held_by_current_thread (&lock);
+  if (!had_fs_lock)
+    lock_acquire (&lock);
+  file_close (m->file);
+  if (!had_fs_lock)
+    lock_release (&lock);
+
+  free (m);
+}
@@ -0,0 +1,52 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct file;
+struct process;
+
+/* Memory-mapped files.
+
+   A mapping makes the contents of a file appear as a range of
+   consecutive pages in a process's address space.  The pages
+   are read from the file as they are touched, and written back
+   when they are dirty: on munmap(), when the process exits, and
+   when they are evicted.  Processes that map the same part of a
+   file share its pages in memory, so each sees the others'
+   writes at once, as with MAP_SHARED elsewhere.  Mappings of a
+   file made while it had different lengths share only the pages
+   that do not hold its end.
+
+   A mapping may not overlap the stack slot of any of the
+   process's threads, but it may use slots that are free, such
+   as 0xbf000000, which keeps new threads out of them until it
+   is unmapped.
+
+   fork() gives the child its own handle on each mapped file, by
+   mmap_copy(), and shares the mapping's pages with it, writable,
+   rather than copy-on-write like the rest of the address space,
+   so that parent and child see each other's writes and the file
+   gets them all. */
+
+/* A mapping. */
+struct mapping
+  {
+    int id;                     /* Mapping identifier. */
+    struct file *file;          /* Mapped file, reopened for us. */
+    void *base;                 /* First page of mapping. */
+    size_t page_cnt;            /* Number of pages. */
+    bool unmapping;             /* munmap() in progress? */
+    struct list_elem elem;      /* Element in process's list. */
+  };
+
+int mmap_map (struct file *, void *addr);
+void mmap_unmap (struct process *, int id);
+void mmap_unmap_all (struct process *);
+bool mmap_copy (struct process *child, struct process *parent);
+struct file *mmap_file (struct process *, const void *upage);
+bool mmap_overlaps (struct process *, const void *addr, size_t size);
+
+#endif /* vm/mmap.h */
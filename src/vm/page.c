@@ -0,0 +1,714 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/swap.h"
+
+/* Maximum size of a thread's stack, in pages, set by the -sl
+   option.  A stack can never be bigger than the stack slot it
+   lives in, so neither can this. */
+size_t stack_page_limit = THREAD_STACK_SPACE / PGSIZE;
+
+/* Supplemental page table entries. */
+static struct slab_cache page_cache;
+
+/* Statistics. */
+static unsigned long long added_cnt;    /* Pages added. */
+static unsigned long long file_cnt;     /* Pages read from files. */
+static unsigned long long zero_cnt;     /* Pages zero-filled. */
+static unsigned long long stack_cnt;    /* Stack pages added on demand. */
+static unsigned long long fork_cnt;     /* Pages copied by fork(). */
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destructor;
+static bool add_page (void *upage, bool writable, bool mapped,
+                      struct file *, off_t ofs, uint32_t read_bytes);
+static struct page *find_page (struct process *, const void *upage);
+static struct page *bring_in (struct process *, const void *upage);
+static bool load_page (struct process *, struct page *);
+static bool write_back (struct page *, bool wait);
+static bool copy_page (struct process *child, struct process *parent,
+                       struct page *);
+static bool unshare (struct process *, struct page *);
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void)
+{
+  slab_cache_init (&page_cache, "page", sizeof (struct page), NULL, NULL);
+  frame_init ();
+}
+
+/* Prints supplemental page table statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Page: %llu pages added, %llu read from files, %llu zero-filled, "
+          "%llu stack pages grown, %llu copied by fork\n",
+          added_cnt, file_cnt, zero_cnt, stack_cnt, fork_cnt);
+  frame_print_stats ();
+  swap_print_stats ();
+}
+
+/* Initializes P's page table, empty.  Returns true if
+   successful, false on memory allocation failure. */
+bool
+page_table_init (struct process *p)
+{
+  lock_init (&p->pages.lock);
+  return hash_init (&p->pages.pages, page_hash, page_less, p);
+}
+
+/* Frees P's page table and all of its pages, including their
+   frames and swap slots.  P's page directory must still exist,
+   but must not be active. */
+void
+page_table_destroy (struct process *p)
+{
+  lock_acquire (&p->pages.lock);
+  hash_destroy (&p->pages.pages, page_destructor);
+  lock_release (&p->pages.lock);
+}
+
+/* Fills CHILD's empty page table with copies of PARENT's pages,
+   for fork().  Pages in memory are shared with the child, and
+   writable ones become copy-on-write in both processes, except
+   for pages of memory-mapped files, which stay shared.  Pages of
+   the stacks of PARENT's threads other than the first are left
+   out, but not memory-mapped pages in free stack slots.  Pages of
+   memory-mapped files that CHILD does not map are left out too,
+   which happens only if another of PARENT's threads is changing
+   its mappings.  CHILD's executable must be open already, and its
+   mappings copied by mmap_copy().  Returns true if successful,
+   false if memory or swap is short, in which case CHILD's page
+   table holds the pages copied so far. */
+bool
+page_table_copy (struct process *child, struct process *parent)
+{
+  uint8_t *stacks = (uint8_t *) PHYS_BASE
+                    - PROCESS_THREAD_MAX * THREAD_STACK_SPACE;
+  uint8_t *first_stack = (uint8_t *) PHYS_BASE - THREAD_STACK_SPACE;
+  struct hash_iterator i;
+  bool success = true;
+
+  /* Nothing here allocates a frame, so no eviction can try for
+     the locks we hold. */
+  lock_acquire (&parent->pages.lock);
+  lock_acquire (&child->pages.lock);
+  hash_first (&i, &parent->pages.pages);
+  while (success && hash_next (&i))
+    {
+      struct page *pg = hash_entry (hash_cur (&i), struct page, hash_elem);
+      uint8_t *upage = pg->upage;
+
+      if (pg->mapped || upage < stacks || upage >= first_stack)
+        success = copy_page (child, parent, pg);
+    }
+  lock_release (&child->pages.lock);
+  lock_release (&parent->pages.lock);
+  return success;
+}
+
+/* Adds UPAGE to the current process's address space, to be
+   initialized on first access with READ_BYTES bytes from FILE
+   starting at offset OFS, and zeros in the rest of the page.
+   The page is writable by the user process if WRITABLE is true,
+   read-only otherwise.  Returns true if successful, false if
+   UPAGE is already in the address space or memory is short. */
+bool
+page_add_file (struct file *file, off_t ofs, void *upage,
+               uint32_t read_bytes, bool writable)
+{
+  return add_page (upage, writable, false, read_bytes > 0 ? file : NULL,
+                   ofs, read_bytes);
+}
+
+/* Adds UPAGE to the current process's address space, to be
+   zeroed on first access.  Returns true if successful, false if
+   UPAGE is already in the address space or memory is short. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return add_page (upage, writable, false, NULL, 0, 0);
+}
+
+/* Adds UPAGE to the current process's address space as a page of
+   a memory-mapped file: READ_BYTES bytes of FILE at offset OFS,
+   followed by zeros.  The page is read from FILE on first access,
+   and written back to it when it is dirty.  Returns true if
+   successful, false if UPAGE is already in the address space or
+   memory is short. */
+bool
+page_add_mapped (struct file *file, off_t ofs, void *upage,
+                 uint32_t read_bytes)
+{
+  ASSERT (read_bytes > 0);
+
+  return add_page (upage, true, true, file, ofs, read_bytes);
+}
+
+/* Removes UPAGE, if present, from P's address space, freeing its
+   frame or swap slot.  A dirty page of a memory-mapped file is
+   written back first. */
+void
+page_remove (struct process *p, void *upage)
+{
+  struct page *pg;
+
+  lock_acquire (&p->pages.lock);
+  pg = find_page (p, upage);
+  if (pg != NULL)
+    {
+      hash_delete (&p->pages.pages, &pg->hash_elem);
+      page_destructor (&pg->hash_elem, p);
+    }
+  lock_release (&p->pages.lock);
+}
+
+/* Brings the page containing user address ADDR into memory, if
+   it is part of the current process's address space.  Returns
+   true if the page is now mapped, false if ADDR is not a valid
+   address or memory is short. */
+bool
+page_load (const void *addr)
+{
+  struct process *p = thread_current ()->process;
+  bool success;
+
+  if (p == NULL || !is_user_vaddr (addr))
+    return false;
+
+  lock_acquire (&p->pages.lock);
+  success = bring_in (p, pg_round_down (addr)) != NULL;
+  lock_release (&p->pages.lock);
+  return success;
+}
+
+/* Grows the current thread's stack to cover user address ADDR,
+   if ADDR looks like a stack access: it must be no more than 32
+   bytes below ESP, the thread's user stack pointer, which allows
+   for PUSHA, and within stack_page_limit pages of the top of the
+   thread's stack slot.  Returns true if ADDR is now mapped, false
+   otherwise. */
+bool
+page_grow_stack (const void *addr, const void *esp)
+{
+  struct thread *t = thread_current ();
+  uint8_t *top, *bottom;
+
+  if (t->process == NULL)
+    return false;
+
+  top = (uint8_t *) PHYS_BASE - t->stack_slot * THREAD_STACK_SPACE;
+  bottom = top - stack_page_limit * PGSIZE;
+  if ((const uint8_t *) addr >= top || (const uint8_t *) addr < bottom
+      || (const uint8_t *) addr + 32 < (const uint8_t *) esp)
+    return false;
+
+  /* Another of our threads may have added the page already, in
+     which case this fails harmlessly. */
+  if (page_add_zero (pg_round_down (addr), true))
+    stack_cnt++;
+  return page_load (addr);
+}
+
+/* Gives the current process a private copy of the page that
+   contains user address ADDR, if it shares that page
+   copy-on-write with another process, and makes it writable.
+   Called on a write fault on a present page.  Returns true if
+   the page may now be written, false if it is not a writable
+   page or memory is short. */
+bool
+page_unshare (const void *addr)
+{
+  struct process *p = thread_current ()->process;
+  struct page *pg;
+  bool success;
+
+  if (p == NULL || !is_user_vaddr (addr))
+    return false;
+
+  /* Another of our threads may have got the copy, or the page may
+     have been evicted, while we waited for the lock. */
+  lock_acquire (&p->pages.lock);
+  pg = bring_in (p, pg_round_down (addr));
+  success = pg != NULL && pg->writable && (!pg->cow || unshare (p, pg));
+  lock_release (&p->pages.lock);
+  return success;
+}
+
+/* Evicts page PG from its frame.  If it was modified, a page of
+   a memory-mapped file is written back to the file, and any other
+   page to swap.  Returns true if successful, false if it had to
+   be written and could not be, in which case PG stays in its
+   frame.  The page table lock of PG's process must be held. */
+bool
+page_out (struct page *pg)
+{
+  struct process *p = pg->process;
+  void *kpage = pg->frame->kpage;
+  bool written;
+
+  ASSERT (lock_held_by_current_thread (&p->pages.lock));
+  ASSERT (!pg->pinned);
+
+  /* Unmap it first, so that if one of P's threads touches the
+     page while we write it out, the thread waits for us.  The
+     dirty bit survives in the cleared PTE. */
+  pagedir_clear_page (p->pagedir, pg->upage);
+  if (pagedir_is_dirty (p->pagedir, pg->upage))
+    pg->dirty = true;
+
+  if (!pg->dirty)
+    written = true;
+  else if (pg->mapped)
+    {
+      /* Don't wait for the file system lock: its holder may be
+         waiting for P's page table lock, which we hold. */
+      written = write_back (pg, false);
+      if (written)
+        pg->dirty = false;
+    }
+  else
+    {
+      pg->swap_slot = swap_out (kpage);
+      written = pg->swap_slot != SWAP_ERROR;
+    }
+
+  if (!written)
+    {
+      pagedir_set_page (p->pagedir, pg->upage, kpage,
+                        pg->writable && !pg->cow);
+      return false;
+    }
+  pg->frame = NULL;
+  return true;
+}
+
+/* Returns true if all of the SIZE bytes at user address ADDR are
+   in pages that the current process may write.  The kernel
+   ignores page protection when it writes to user memory, so
+   system calls that store into user buffers must check this. */
+bool
+page_writable (const void *addr, size_t size)
+{
+  struct process *p = thread_current ()->process;
+  const uint8_t *end = (const uint8_t *) addr + size;
+  const uint8_t *upage;
+  bool writable = true;
+
+  if (p == NULL)
+    return false;
+
+  lock_acquire (&p->pages.lock);
+  for (upage = pg_round_down (addr); upage < end && writable;
+       upage += PGSIZE)
+    {
+      struct page *pg = find_page (p, upage);
+      writable = pg != NULL && pg->writable;
+    }
+  lock_release (&p->pages.lock);
+  return writable;
+}
+
+/* Brings each page of the SIZE bytes at user address ADDR into
+   memory, and pins it there, so that the kernel can access the
+   buffer while it holds locks that a page fault would need.
+   Pages that cannot be brought in are left to fault.
+
+   If WRITE is true, the kernel is going to store into the buffer,
+   which would not fault on a copy-on-write page, so such pages
+   get copied first.  Returns false if that fails for any page,
+   true otherwise. */
+bool
+page_pin (const void *addr, size_t size, bool write)
+{
+  struct process *p = thread_current ()->process;
+  const uint8_t *end = (const uint8_t *) addr + size;
+  const uint8_t *upage;
+  bool success = true;
+
+  if (p == NULL)
+    return false;
+
+  lock_acquire (&p->pages.lock);
+  for (upage = pg_round_down (addr); upage < end && is_user_vaddr (upage);
+       upage += PGSIZE)
+    {
+      struct page *pg = bring_in (p, upage);
+      if (pg != NULL && write && pg->cow && !unshare (p, pg))
+        success = false;
+      if (pg != NULL && !pg->pinned)
+        {
+          pg->pinned = true;
+          frame_pin (pg->frame);
+        }
+    }
+  lock_release (&p->pages.lock);
+  return success;
+}
+
+/* Unpins the pages of the SIZE bytes at user address ADDR. */
+void
+page_unpin (const void *addr, size_t size)
+{
+  struct process *p = thread_current ()->process;
+  const uint8_t *end = (const uint8_t *) addr + size;
+  const uint8_t *upage;
+
+  if (p == NULL)
+    return;
+
+  lock_acquire (&p->pages.lock);
+  for (upage = pg_round_down (addr); upage < end && is_user_vaddr (upage);
+       upage += PGSIZE)
+    {
+      struct page *pg = find_page (p, upage);
+      if (pg != NULL && pg->pinned)
+        {
+          pg->pinned = false;
+          frame_unpin (pg->frame);
+        }
+    }
+  lock_release (&p->pages.lock);
+}
+
+/* Adds UPAGE to the current process's address space, with
+   initial contents as described in page_add_file().  MAPPED is
+   true for a page of a memory-mapped file. */
+static bool
+add_page (void *upage, bool writable, bool mapped, struct file *file,
+          off_t ofs, uint32_t read_bytes)
+{
+  struct process *p = thread_current ()->process;
+  struct page *pg;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  pg = slab_alloc (&page_cache);
+  if (pg == NULL)
+    return false;
+  pg->upage = upage;
+  pg->process = p;
+  pg->writable = writable;
+  pg->mapped = mapped;
+  pg->frame = NULL;
+  pg->pinned = false;
+  pg->swap_slot = SWAP_ERROR;
+  pg->dirty = false;
+  pg->cow = false;
+  pg->file = file;
+  pg->file_ofs = ofs;
+  pg->read_bytes = read_bytes;
+
+  lock_acquire (&p->pages.lock);
+  if (hash_insert (&p->pages.pages, &pg->hash_elem) != NULL)
+    {
+      lock_release (&p->pages.lock);
+      slab_free (&page_cache, pg);
+      return false;
+    }
+  lock_release (&p->pages.lock);
+  added_cnt++;
+  return true;
+}
+
+/* Returns page UPAGE of P, or a null pointer if UPAGE is not in
+   P's address space.  P's page table lock must be held. */
+static struct page *
+find_page (struct process *p, const void *upage)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.upage = (void *) upage;
+  e = hash_find (&p->pages.pages, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Returns page UPAGE of P, brought into memory if it was not
+   already, or a null pointer if UPAGE is not in P's address
+   space or memory is short.  P's page table lock must be held.
+   Another of P's threads may have brought the page in while we
+   waited for the lock. */
+static struct page *
+bring_in (struct process *p, const void *upage)
+{
+  struct page *pg = find_page (p, upage);
+
+  if (pg != NULL && pg->frame == NULL && !load_page (p, pg))
+    return NULL;
+  return pg;
+}
+
+/* Gets a frame for PG, fills it in, and maps it into P's page
+   directory.  Read-only file data is shared with other processes
+   that map it, and so are the pages of memory-mapped files,
+   writable, so that the processes see each other's writes.
+   Returns true if successful, false on failure. */
+static bool
+load_page (struct process *p, struct page *pg)
+{
+  bool share = pg->file != NULL && (pg->mapped || !pg->writable);
+  struct inode *inode = share ? file_get_inode (pg->file) : NULL;
+  struct frame *f = NULL;
+
+  /* A page that was copy-on-write gets a frame of its own. */
+  pg->cow = false;
+  while (f == NULL)
+    {
+      bool zero;
+
+      if (share)
+        f = frame_share (pg, inode, pg->file_ofs, pg->read_bytes,
+                         pg->mapped);
+      if (f != NULL)
+        break;
+
+      zero = pg->swap_slot == SWAP_ERROR && pg->file == NULL;
+      f = frame_alloc (pg, zero);
+      if (f == NULL)
+        return false;
+
+      if (pg->swap_slot != SWAP_ERROR)
+        {
+          swap_in (pg->swap_slot, f->kpage);
+          pg->swap_slot = SWAP_ERROR;
+        }
+      else if (pg->file != NULL)
+        {
+          /* We may be in the middle of a file system call, if the
+             kernel faulted on a user buffer. */
+          bool had_fs_lock = lock_held_by_current_thread (&lock);
+          off_t n;
+
+          if (!had_fs_lock)
+            lock_acquire (&lock);
+          n = file_read_at (pg->file, f->kpage, pg->read_bytes,
+                            pg->file_ofs);
+          if (!had_fs_lock)
+            lock_release (&lock);
+          if (n != (off_t) pg->read_bytes)
+            {
+              frame_release (f, pg);
+              return false;
+            }
+          memset ((uint8_t *) f->kpage + pg->read_bytes, 0,
+                  PGSIZE - pg->read_bytes);
+          file_cnt++;
+
+          /* Null means the data may be stale, so read it again. */
+          if (share)
+            f = frame_publish (f, pg, inode, pg->file_ofs,
+                               pg->read_bytes, pg->mapped);
+        }
+      else
+        zero_cnt++;
+    }
+
+  if (!pagedir_set_page (p->pagedir, pg->upage, f->kpage, pg->writable))
+    {
+      frame_unpin (f);
+      frame_release (f, pg);
+      return false;
+    }
+  pg->frame = f;
+  frame_unpin (f);
+  return true;
+}
+
+/* Writes page PG, which must be in a frame, back to its file.
+   Waits for the file system lock if WAIT is true; otherwise,
+   gives up if it is busy.  Returns true if successful. */
+static bool
+write_back (struct page *pg, bool wait)
+{
+  bool had_fs_lock = lock_held_by_current_thread (&lock);
+  off_t n;
+
+  ASSERT (pg->mapped && pg->frame != NULL);
+
+  if (!had_fs_lock)
+    {
+      if (wait)
+        lock_acquire (&lock);
+      else if (!lock_try_acquire (&lock))
+        return false;
+    }
+  n = file_write_at (pg->file, pg->frame->kpage, pg->read_bytes,
+                     pg->file_ofs);
+  if (!had_fs_lock)
+    lock_release (&lock);
+  return n == (off_t) pg->read_bytes;
+}
+
+/* Adds a copy of PARENT's page PG to CHILD's page table, as
+   described in page_table_copy().  Both page table locks must be
+   held. */
+static bool
+copy_page (struct process *child, struct process *parent, struct page *pg)
+{
+  struct page *copy = slab_alloc (&page_cache);
+
+  if (copy == NULL)
+    return false;
+  *copy = *pg;
+  copy->process = child;
+  copy->frame = NULL;
+  copy->pinned = false;
+  copy->swap_slot = SWAP_ERROR;
+  copy->cow = false;
+  if (pg->mapped)
+    {
+      copy->file = mmap_file (child, pg->upage);
+      if (copy->file == NULL)
+        {
+          slab_free (&page_cache, copy);
+          return true;
+        }
+    }
+  else if (pg->file == parent->executable)
+    copy->file = child->executable;
+
+  if (pg->frame != NULL)
+    {
+      void *kpage = pg->frame->kpage;
+
+      if (pagedir_is_dirty (parent->pagedir, pg->upage))
+        pg->dirty = copy->dirty = true;
+
+      if (pg->mapped)
+        {
+          /* Pages of memory-mapped files are shared, not copied,
+             as they are with other processes that map the file. */
+          if (!pagedir_set_page (child->pagedir, copy->upage, kpage,
+                                 pg->writable))
+            goto error;
+          copy->frame = pg->frame;
+          frame_add (pg->frame, copy);
+        }
+      else if (pg->pinned && pg->writable)
+        {
+          /* One of the parent's threads may be storing into the
+             page from the kernel, which copy-on-write would not
+             catch, so the child gets its copy now, in swap. */
+          copy->swap_slot = swap_out (kpage);
+          if (copy->swap_slot == SWAP_ERROR)
+            goto error;
+          copy->dirty = true;
+        }
+      else
+        {
+          /* Write-protect the parent's mapping.  Clearing it first
+             flushes it from the TLB. */
+          if (pg->writable && !pg->cow)
+            {
+              pagedir_clear_page (parent->pagedir, pg->upage);
+              pagedir_set_page (parent->pagedir, pg->upage, kpage, false);
+              pg->cow = true;
+            }
+          if (!pagedir_set_page (child->pagedir, copy->upage, kpage, false))
+            goto error;
+          copy->cow = pg->cow;
+          copy->frame = pg->frame;
+          frame_add (pg->frame, copy);
+        }
+    }
+  else if (pg->swap_slot != SWAP_ERROR)
+    {
+      copy->swap_slot = swap_copy (pg->swap_slot);
+      if (copy->swap_slot == SWAP_ERROR)
+        goto error;
+    }
+
+  hash_insert (&child->pages.pages, &copy->hash_elem);
+  fork_cnt++;
+  return true;
+
+ error:
+  slab_free (&page_cache, copy);
+  return false;
+}
+
+/* Moves P's copy-on-write page PG, which is in a frame, to a
+   frame of its own, unless it is already alone in its frame, and
+   maps it writable.  Returns true if successful, false if no
+   frame could be freed.  P's page table lock must be held. */
+static bool
+unshare (struct process *p, struct page *pg)
+{
+  struct frame *old = pg->frame;
+  struct frame *f;
+
+  ASSERT (pg->cow && pg->frame != NULL);
+
+  /* Unmap it first, which flushes the read-only mapping from the
+     TLB.  The dirty bit survives in the cleared PTE. */
+  pagedir_clear_page (p->pagedir, pg->upage);
+  if (pagedir_is_dirty (p->pagedir, pg->upage))
+    pg->dirty = true;
+
+  f = frame_unshare (pg);
+  if (f == NULL)
+    {
+      pagedir_set_page (p->pagedir, pg->upage, old->kpage, false);
+      return false;
+    }
+  pagedir_set_page (p->pagedir, pg->upage, f->kpage, true);
+  pg->frame = f;
+  pg->cow = false;
+  return true;
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *pg = hash_entry (e, struct page, hash_elem);
+  return hash_int ((uintptr_t) pg->upage >> PGBITS);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
+
+/* Frees the page that E refers to, which belongs to process P_,
+   along with its frame or swap slot, after writing it back to
+   its file if it is a dirty page of a memory-mapped file. */
+static void
+page_destructor (struct hash_elem *e, void *p_)
+{
+  struct page *pg = hash_entry (e, struct page, hash_elem);
+  struct process *p = p_;
+
+  if (pg->frame != NULL)
+    {
+      pagedir_clear_page (p->pagedir, pg->upage);
+      if (pg->mapped
+          && (pg->dirty || pagedir_is_dirty (p->pagedir, pg->upage)))
+        write_back (pg, true);
+      if (pg->pinned)
+        frame_unpin (pg->frame);
+      frame_release (pg->frame, pg);
+    }
+  if (pg->swap_slot != SWAP_ERROR)
+    swap_free (pg->swap_slot);
+  slab_free (&page_cache, pg);
+}
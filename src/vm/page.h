@@ -0,0 +1,100 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct process;
+
+/* Supplemental page table.
+
+   The page directory only records the user pages that are in
+   memory.  The supplemental page table records, for each page
+   of a process's address space that is not necessarily in
+   memory, where its contents come from, so that the page can be
+   brought in when it is first touched.
+
+   Executable segments are added to it by load(), instead of
+   being read in up front, and page_load() reads each page in
+   from the page fault handler on first access.
+
+   A page in memory occupies a frame (see vm/frame.h), which may
+   be taken away from it when memory is short.  A page that was
+   ever modified is then written to swap, and read back from
+   there on its next access.  Other pages are just dropped, to be
+   read from their file or zeroed again.  Pages of memory-mapped
+   files are different: they are written back to their file when
+   they are dirty, and always read from there.
+
+   A thread's stack starts out as a single page, and grows by
+   page_grow_stack() as the thread faults below it, up to
+   stack_page_limit pages.
+
+   fork() gives the child a copy of its parent's page table by
+   page_table_copy().  Pages in memory are not copied: parent and
+   child share each frame, and a writable page is mapped
+   read-only in both and marked copy-on-write.  The first write
+   to it faults, and page_unshare() gives the writer a copy of its
+   own.  Pages of memory-mapped files are the exception: they
+   stay writable and shared, so that parent and child see each
+   other's writes. */
+
+/* A page of user virtual memory. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    struct process *process;    /* Owning process. */
+    struct hash_elem hash_elem; /* Element in page table. */
+    bool writable;              /* Writable by the user process? */
+    bool mapped;                /* Part of a memory-mapped file? */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    struct list_elem frame_elem; /* Element in frame's page list. */
+    bool pinned;                /* Pinned in its frame? */
+    size_t swap_slot;           /* Swap slot holding it, or SWAP_ERROR. */
+    bool dirty;                 /* Modified since read from file? */
+    bool cow;                   /* Shared copy-on-write with a fork? */
+
+    /* Initial contents: READ_BYTES bytes from FILE at FILE_OFS,
+       followed by zeros.  FILE is null for an all-zero page. */
+    struct file *file;
+    off_t file_ofs;
+    uint32_t read_bytes;
+  };
+
+/* A process's supplemental page table. */
+struct page_table
+  {
+    struct hash pages;          /* Pages, keyed by upage. */
+    struct lock lock;           /* Protects the pages and their frames. */
+  };
+
+/* Maximum size of a thread's stack, in pages. */
+extern size_t stack_page_limit;
+
+void page_init (void);
+void page_print_stats (void);
+
+bool page_table_init (struct process *);
+void page_table_destroy (struct process *);
+bool page_table_copy (struct process *child, struct process *parent);
+
+bool page_add_file (struct file *, off_t ofs, void *upage,
+                    uint32_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mapped (struct file *, off_t ofs, void *upage,
+                      uint32_t read_bytes);
+void page_remove (struct process *, void *upage);
+
+bool page_load (const void *addr);
+bool page_grow_stack (const void *addr, const void *esp);
+bool page_unshare (const void *addr);
+bool page_out (struct page *);
+bool page_writable (const void *addr, size_t size);
+bool page_pin (const void *addr, size_t size, bool write);
+void page_unpin (const void *addr, size_t size);
+
+#endif /* vm/page.h */
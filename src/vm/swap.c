@@ -0,0 +1,140 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap space.
+
+   The swap block device is divided into page-sized slots, each
+   of which can hold one evicted page.  A bitmap records which
+   slots are in use.  Slots are written and read without holding
+   any lock: a slot belongs to the one page that was written to
+   it until swap_in() or swap_free() gives it back. */
+
+/* Sectors per swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Swap device, or null if there is none. */
+static struct block *swap_device;
+
+/* Slots in use.  Protected by swap_lock. */
+static struct bitmap *used_slots;
+static struct lock swap_lock;
+
+/* Statistics. */
+static unsigned long long out_cnt;      /* Pages written. */
+static unsigned long long in_cnt;       /* Pages read. */
+
+static void read_slot (size_t slot, void *kpage);
+
+/* Initializes swap space.  Without a swap device, swap_out()
+   always fails. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    {
+      printf ("swap: no swap device, pages will not be swapped\n");
+      return;
+    }
+  used_slots = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (used_slots == NULL)
+    PANIC ("swap: bitmap creation failed");
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  if (used_slots == NULL)
+    return;
+  printf ("Swap: %zu of %zu slots in use, %llu pages out, %llu in\n",
+          bitmap_count (used_slots, 0, bitmap_size (used_slots), true),
+          bitmap_size (used_slots), out_cnt, in_cnt);
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot's index, or SWAP_ERROR if swap is full or missing. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot;
+  size_t i;
+
+  if (used_slots == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    out_cnt++;
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                 (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  return slot;
+}
+
+/* Reads swap slot SLOT into KPAGE and frees the slot. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  read_slot (slot, kpage);
+
+  lock_acquire (&swap_lock);
+  bitmap_reset (used_slots, slot);
+  in_cnt++;
+  lock_release (&swap_lock);
+}
+
+/* Frees swap slot SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  ASSERT (used_slots != NULL);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  bitmap_reset (used_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Copies swap slot SLOT into a free slot, and returns the new
+   slot's index, or SWAP_ERROR if swap is full or memory is
+   short. */
+size_t
+swap_copy (size_t slot)
+{
+  void *buffer = palloc_get_page (0);
+  size_t copy;
+
+  if (buffer == NULL)
+    return SWAP_ERROR;
+  read_slot (slot, buffer);
+  copy = swap_out (buffer);
+  palloc_free_page (buffer);
+  return copy;
+}
+
+/* Reads swap slot SLOT, which must be in use, into KPAGE. */
+static void
+read_slot (size_t slot, void *kpage)
+{
+  size_t i;
+
+  ASSERT (used_slots != NULL);
+  ASSERT (bitmap_test (used_slots, slot));
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_device, slot * SECTORS_PER_SLOT + i,
+                (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+}
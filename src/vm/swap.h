@@ -0,0 +1,18 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/* Swap slot index returned by swap_out() on failure, and stored
+   in pages that are not in swap. */
+#define SWAP_ERROR ((size_t) -1)
+
+void swap_init (void);
+void swap_print_stats (void);
+
+size_t swap_out (const void *kpage);
+void swap_in (size_t slot, void *kpage);
+void swap_free (size_t slot);
+size_t swap_copy (size_t slot);
+
+#endif /* vm/swap.h */